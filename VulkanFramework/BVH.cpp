@@ -0,0 +1,373 @@
+#include "BVH.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <numeric>
+
+void AABB::Grow(const glm::vec3& point)
+{
+	min = glm::min(min, point);
+	max = glm::max(max, point);
+}
+
+void AABB::Grow(const AABB& other)
+{
+	min = glm::min(min, other.min);
+	max = glm::max(max, other.max);
+}
+
+glm::vec3 AABB::GetCentroid() const
+{
+	return (min + max) * 0.5f;
+}
+
+float AABB::GetSurfaceArea() const
+{
+	if (IsEmpty())
+		return 0.f;
+	glm::vec3 extent = max - min;
+	return 2.f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+bool AABB::IsEmpty() const
+{
+	return min.x > max.x || min.y > max.y || min.z > max.z;
+}
+
+void BVH::Build(const std::vector<AABB>& primitiveBounds, uint32_t maxLeafSize, ThreadPool* pThreadPool)
+{
+	m_MaxLeafSize = std::max(maxLeafSize, 1u);
+	m_Nodes.clear();
+	m_PrimitiveIndices.resize(primitiveBounds.size());
+	std::iota(m_PrimitiveIndices.begin(), m_PrimitiveIndices.end(), 0);
+
+	if (primitiveBounds.empty())
+	{
+		m_SAHCost = 0.f;
+		m_MaxDepth = 0;
+		return;
+	}
+
+	//A subtree over n primitives never has more than 2n-1 nodes, reserving that many slots per subtree lets every subtree
+	//be built independently. Slots left unused because a leaf holds multiple primitives are removed by Compact().
+	m_Nodes.resize(primitiveBounds.size() * 2 - 1);
+	BuildRecursive(primitiveBounds, 0, uint32_t(primitiveBounds.size()), 0, pThreadPool);
+	Compact();
+	m_SAHCost = ComputeSAHCost();
+	m_MaxDepth = ComputeMaxDepth();
+}
+
+void BVH::Refit(const std::vector<AABB>& sortedPrimitiveBounds)
+{
+	//Nodes are stored depth first so children always come after their parent
+	for (size_t i = m_Nodes.size(); i-- > 0;)
+	{
+		BVHNode& node = m_Nodes[i];
+		AABB bounds{};
+		if (node.rightCount & BVH_LEAF_BIT)
+		{
+			uint32_t last = node.leftFirst + (node.rightCount & ~BVH_LEAF_BIT);
+			for (uint32_t primitive = node.leftFirst; primitive < last; primitive++)
+			{
+				bounds.Grow(sortedPrimitiveBounds[primitive]);
+			}
+		}
+		else
+		{
+			bounds.Grow(AABB{ m_Nodes[node.leftFirst].min, m_Nodes[node.leftFirst].max });
+			bounds.Grow(AABB{ m_Nodes[node.rightCount].min, m_Nodes[node.rightCount].max });
+		}
+		node.min = bounds.min;
+		node.max = bounds.max;
+	}
+	m_SAHCost = ComputeSAHCost();
+}
+
+const std::vector<BVHNode>& BVH::GetNodes() const
+{
+	return m_Nodes;
+}
+
+const std::vector<uint32_t>& BVH::GetPrimitiveIndices() const
+{
+	return m_PrimitiveIndices;
+}
+
+float BVH::GetSAHCost() const
+{
+	return m_SAHCost;
+}
+
+uint32_t BVH::GetMaxDepth() const
+{
+	return m_MaxDepth;
+}
+
+void BVH::BuildRecursive(const std::vector<AABB>& primitiveBounds, uint32_t first, uint32_t count, uint32_t nodeIndex, ThreadPool* pThreadPool)
+{
+	std::vector<AABB> chunkBounds(GetChunkCount(count, pThreadPool));
+	std::vector<AABB> chunkCentroidBounds(chunkBounds.size());
+	ForEachChunk(count, pThreadPool, [&](uint32_t chunk, uint32_t begin, uint32_t end)
+	{
+		for (uint32_t i = first + begin; i < first + end; i++)
+		{
+			chunkBounds[chunk].Grow(primitiveBounds[m_PrimitiveIndices[i]]);
+			chunkCentroidBounds[chunk].Grow(primitiveBounds[m_PrimitiveIndices[i]].GetCentroid());
+		}
+	});
+
+	AABB bounds{};
+	AABB centroidBounds{};
+	for (size_t chunk = 0; chunk < chunkBounds.size(); chunk++)
+	{
+		bounds.Grow(chunkBounds[chunk]);
+		centroidBounds.Grow(chunkCentroidBounds[chunk]);
+	}
+	m_Nodes[nodeIndex].min = bounds.min;
+	m_Nodes[nodeIndex].max = bounds.max;
+
+	uint32_t leftCount = Partition(primitiveBounds, first, count, bounds, centroidBounds, pThreadPool);
+	if (leftCount == 0)
+	{
+		m_Nodes[nodeIndex].leftFirst = first;
+		m_Nodes[nodeIndex].rightCount = count | BVH_LEAF_BIT;
+		return;
+	}
+
+	//The left subtree owns the 2 * leftCount - 1 slots after this node, the right subtree the slots after those
+	uint32_t left = nodeIndex + 1;
+	uint32_t right = nodeIndex + 2 * leftCount;
+	m_Nodes[nodeIndex].leftFirst = left;
+	m_Nodes[nodeIndex].rightCount = right;
+
+	if (pThreadPool != nullptr && count >= ParallelSubtreeThreshold)
+	{
+		ThreadPool::TaskGroup group{};
+		pThreadPool->Submit(group, [this, &primitiveBounds, first, leftCount, left, pThreadPool]()
+		{
+			BuildRecursive(primitiveBounds, first, leftCount, left, pThreadPool);
+		});
+		BuildRecursive(primitiveBounds, first + leftCount, count - leftCount, right, pThreadPool);
+		pThreadPool->Wait(group);
+	}
+	else
+	{
+		BuildRecursive(primitiveBounds, first, leftCount, left, pThreadPool);
+		BuildRecursive(primitiveBounds, first + leftCount, count - leftCount, right, pThreadPool);
+	}
+}
+
+// Returns the amount of primitives moved to the left child, 0 means the node should become a leaf.
+uint32_t BVH::Partition(const std::vector<AABB>& primitiveBounds, uint32_t first, uint32_t count, const AABB& bounds, const AABB& centroidBounds, ThreadPool* pThreadPool)
+{
+	if (count <= 1)
+		return 0;
+
+	glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+	if (extent.x <= 0.f && extent.y <= 0.f && extent.z <= 0.f)
+	{
+		//All centroids coincide, binning can't separate them
+		if (count <= m_MaxLeafSize)
+			return 0;
+		return count / 2;
+	}
+
+	glm::vec3 scale{};
+	for (int axis = 0; axis < 3; axis++)
+	{
+		scale[axis] = (extent[axis] > 0.f) ? BinCount / extent[axis] : 0.f;
+	}
+
+	std::vector<Bins> chunkBins(GetChunkCount(count, pThreadPool));
+	ForEachChunk(count, pThreadPool, [&](uint32_t chunk, uint32_t begin, uint32_t end)
+	{
+		Bins& bins = chunkBins[chunk];
+		for (uint32_t i = first + begin; i < first + end; i++)
+		{
+			const AABB& primBounds = primitiveBounds[m_PrimitiveIndices[i]];
+			glm::vec3 centroid = primBounds.GetCentroid();
+			for (int axis = 0; axis < 3; axis++)
+			{
+				uint32_t bin = std::min(BinCount - 1, uint32_t((centroid[axis] - centroidBounds.min[axis]) * scale[axis]));
+				bins.bounds[axis][bin].Grow(primBounds);
+				bins.counts[axis][bin]++;
+			}
+		}
+	});
+
+	Bins& bins = chunkBins[0];
+	for (size_t chunk = 1; chunk < chunkBins.size(); chunk++)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			for (uint32_t bin = 0; bin < BinCount; bin++)
+			{
+				bins.bounds[axis][bin].Grow(chunkBins[chunk].bounds[axis][bin]);
+				bins.counts[axis][bin] += chunkBins[chunk].counts[axis][bin];
+			}
+		}
+	}
+
+	float bestCost = FLT_MAX;
+	int bestAxis = -1;
+	uint32_t bestSplit = 0;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (extent[axis] <= 0.f)
+			continue;
+
+		//Sweep from the right to gather the cost of every right side, then from the left to evaluate each split
+		float rightAreas[BinCount]{};
+		uint32_t rightCounts[BinCount]{};
+		AABB rightBounds{};
+		uint32_t rightCount = 0;
+		for (uint32_t bin = BinCount - 1; bin > 0; bin--)
+		{
+			rightBounds.Grow(bins.bounds[axis][bin]);
+			rightCount += bins.counts[axis][bin];
+			rightAreas[bin] = rightBounds.GetSurfaceArea();
+			rightCounts[bin] = rightCount;
+		}
+
+		AABB leftBounds{};
+		uint32_t leftCount = 0;
+		for (uint32_t split = 1; split < BinCount; split++)
+		{
+			leftBounds.Grow(bins.bounds[axis][split - 1]);
+			leftCount += bins.counts[axis][split - 1];
+			if (leftCount == 0 || rightCounts[split] == 0)
+				continue;
+			float cost = leftBounds.GetSurfaceArea() * leftCount + rightAreas[split] * rightCounts[split];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = split;
+			}
+		}
+	}
+
+	float area = bounds.GetSurfaceArea();
+	float leafCost = IntersectionCost * count;
+	float splitCost = (area > 0.f) ? TraversalCost + IntersectionCost * bestCost / area : FLT_MAX;
+	if (count <= m_MaxLeafSize && leafCost <= splitCost)
+		return 0;
+
+	if (bestAxis == -1)
+		return count / 2;
+
+	float axisScale = scale[bestAxis];
+	float minCentroid = centroidBounds.min[bestAxis];
+	auto middle = std::partition(m_PrimitiveIndices.begin() + first, m_PrimitiveIndices.begin() + first + count,
+		[&](uint32_t primitive)
+		{
+			uint32_t bin = std::min(BinCount - 1, uint32_t((primitiveBounds[primitive].GetCentroid()[bestAxis] - minCentroid) * axisScale));
+			return bin < bestSplit;
+		});
+	return uint32_t(middle - (m_PrimitiveIndices.begin() + first));
+}
+
+// Moves the nodes to consecutive slots, keeping the depth first order
+void BVH::Compact()
+{
+	std::vector<BVHNode> nodes{};
+	nodes.reserve(m_Nodes.size());
+
+	struct StackEntry
+	{
+		uint32_t slot;
+		uint32_t parent;
+		bool isLeft;
+	};
+	std::vector<StackEntry> stack{ { 0, UINT32_MAX, false } };
+	while (!stack.empty())
+	{
+		StackEntry entry = stack.back();
+		stack.pop_back();
+
+		uint32_t nodeIndex = uint32_t(nodes.size());
+		const BVHNode& node = m_Nodes[entry.slot];
+		nodes.push_back(node);
+		if (entry.parent != UINT32_MAX)
+		{
+			if (entry.isLeft)
+				nodes[entry.parent].leftFirst = nodeIndex;
+			else
+				nodes[entry.parent].rightCount = nodeIndex;
+		}
+
+		if (!(node.rightCount & BVH_LEAF_BIT))
+		{
+			stack.push_back({ node.rightCount, nodeIndex, false });
+			stack.push_back({ node.leftFirst, nodeIndex, true });
+		}
+	}
+	m_Nodes.swap(nodes);
+}
+
+uint32_t BVH::GetChunkCount(uint32_t count, ThreadPool* pThreadPool)
+{
+	if (pThreadPool == nullptr)
+		return 1;
+	return std::max(1u, count / ParallelChunkSize);
+}
+
+void BVH::ForEachChunk(uint32_t count, ThreadPool* pThreadPool, const std::function<void(uint32_t chunk, uint32_t begin, uint32_t end)>& function)
+{
+	uint32_t chunkCount = GetChunkCount(count, pThreadPool);
+	if (chunkCount == 1)
+	{
+		function(0, 0, count);
+		return;
+	}
+
+	//The last chunk also takes the remainder
+	ThreadPool::TaskGroup group{};
+	uint32_t chunkSize = count / chunkCount;
+	for (uint32_t chunk = 1; chunk < chunkCount; chunk++)
+	{
+		uint32_t end = (chunk == chunkCount - 1) ? count : (chunk + 1) * chunkSize;
+		pThreadPool->Submit(group, [&function, chunk, chunkSize, end]() { function(chunk, chunk * chunkSize, end); });
+	}
+	function(0, 0, chunkSize);
+	pThreadPool->Wait(group);
+}
+
+float BVH::ComputeSAHCost() const
+{
+	if (m_Nodes.empty())
+		return 0.f;
+
+	AABB root{ m_Nodes[0].min, m_Nodes[0].max };
+	float rootArea = root.GetSurfaceArea();
+	if (rootArea <= 0.f)
+		return 0.f;
+
+	float cost = 0.f;
+	for (const BVHNode& node : m_Nodes)
+	{
+		float area = AABB{ node.min, node.max }.GetSurfaceArea() / rootArea;
+		if (node.rightCount & BVH_LEAF_BIT)
+			cost += IntersectionCost * (node.rightCount & ~BVH_LEAF_BIT) * area;
+		else
+			cost += TraversalCost * area;
+	}
+	return cost;
+}
+
+uint32_t BVH::ComputeMaxDepth() const
+{
+	//Children come after their parent, so the depth of a node is known before its children are reached
+	std::vector<uint32_t> depths(m_Nodes.size(), 0);
+	uint32_t maxDepth = 0;
+	for (size_t i = 0; i < m_Nodes.size(); i++)
+	{
+		const BVHNode& node = m_Nodes[i];
+		maxDepth = std::max(maxDepth, depths[i]);
+		if (!(node.rightCount & BVH_LEAF_BIT))
+		{
+			depths[node.leftFirst] = depths[i] + 1;
+			depths[node.rightCount] = depths[i] + 1;
+		}
+	}
+	return maxDepth;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <functional>
+#include <cfloat>
+
+class ThreadPool;
+
+struct AABB
+{
+	glm::vec3 min{ FLT_MAX, FLT_MAX, FLT_MAX };
+	glm::vec3 max{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+	void Grow(const glm::vec3& point);
+	void Grow(const AABB& other);
+	glm::vec3 GetCentroid() const;
+	float GetSurfaceArea() const;
+	bool IsEmpty() const;
+};
+
+// Node layout as it is uploaded to the gpu, matches BVHNode in raytracing.comp (32 bytes, std140 and std430 compatible).
+// Interior nodes store the index of both children, leaves store the first primitive and the primitive count with BVH_LEAF_BIT set.
+struct BVHNode
+{
+	glm::vec3 min;
+	uint32_t leftFirst;
+	glm::vec3 max;
+	uint32_t rightCount;
+};
+
+static const uint32_t BVH_LEAF_BIT = 0x80000000u;
+// Entries of the traversal stacks in raytracing_common.glsl, deeper hierarchies would lose nodes on the gpu
+static const uint32_t BVH_STACK_SIZE = 64;
+
+// Binned SAH bounding volume hierarchy over an arbitrary set of primitive bounds.
+// Nodes are stored depth first so the left child of an interior node always directly follows its parent.
+// The primitives referenced by the leaves are ranges in GetPrimitiveIndices(), callers reorder their primitive buffer with it before uploading.
+// When a thread pool is passed, subtrees and the binning of big nodes are spread over its workers, the result is identical to a serial build.
+class BVH
+{
+public:
+	void Build(const std::vector<AABB>& primitiveBounds, uint32_t maxLeafSize = 4, ThreadPool* pThreadPool = nullptr);
+	// Recomputes all node bounds bottom up without changing the topology.
+	// The bounds are expected in leaf order, which is the order of the primitives after reordering them with GetPrimitiveIndices().
+	void Refit(const std::vector<AABB>& sortedPrimitiveBounds);
+
+	const std::vector<BVHNode>& GetNodes() const;
+	const std::vector<uint32_t>& GetPrimitiveIndices() const;
+	float GetSAHCost() const;
+	// Levels below the root of the deepest leaf, Refit keeps it
+	uint32_t GetMaxDepth() const;
+
+	static const uint32_t	BinCount{ 16 };
+	static constexpr float	TraversalCost{ 1.0f };
+	static constexpr float	IntersectionCost{ 1.0f };
+	// Subtrees with less primitives are built on the thread that reached them
+	static const uint32_t	ParallelSubtreeThreshold{ 1024 };
+	// Nodes with more primitives split their bounds and binning passes in chunks of this size
+	static const uint32_t	ParallelChunkSize{ 16384 };
+
+private:
+	struct Bins
+	{
+		AABB bounds[3][BinCount];
+		uint32_t counts[3][BinCount];
+	};
+
+	void BuildRecursive(const std::vector<AABB>& primitiveBounds, uint32_t first, uint32_t count, uint32_t nodeIndex, ThreadPool* pThreadPool);
+	uint32_t Partition(const std::vector<AABB>& primitiveBounds, uint32_t first, uint32_t count, const AABB& bounds, const AABB& centroidBounds, ThreadPool* pThreadPool);
+	void Compact();
+	float ComputeSAHCost() const;
+	uint32_t ComputeMaxDepth() const;
+	static uint32_t GetChunkCount(uint32_t count, ThreadPool* pThreadPool);
+	static void ForEachChunk(uint32_t count, ThreadPool* pThreadPool, const std::function<void(uint32_t chunk, uint32_t begin, uint32_t end)>& function);
+
+	std::vector<BVHNode>		m_Nodes{};
+	std::vector<uint32_t>		m_PrimitiveIndices{};
+	uint32_t					m_MaxLeafSize{ 4 };
+	float						m_SAHCost{};
+	uint32_t					m_MaxDepth{};
+};
+
@@ -2,7 +2,10 @@
 #include "VulkanHelpers.h"
 #include "VulkanDevice.h"
 #include "CommandPool.h"
+#include "StagingRing.h"
 #include <iostream>
+#include <cassert>
+#include <algorithm>
 using namespace vkw;
 
 Buffer::Buffer(VulkanDevice * pDevice, CommandPool* cmdPool, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memPropFlags, size_t size, void * data)
@@ -11,6 +14,22 @@ Buffer::Buffer(VulkanDevice * pDevice, CommandPool* cmdPool, VkBufferUsageFlags
 	Init(usageFlags, memPropFlags, size, data, cmdPool);
 }
 
+Buffer::Buffer(VulkanDevice* pDevice, VkBufferUsageFlags usageFlags, size_t sliceSize, uint32_t sliceCount)
+	:m_pDevice(pDevice), m_SliceCount(sliceCount)
+{
+	// Dynamic offsets have to be a multiple of the alignment of every descriptor type the buffer is used as
+	const VkPhysicalDeviceLimits& limits = m_pDevice->GetPhysicalDeviceProperties().limits;
+	VkDeviceSize alignment{ 1 };
+	if (usageFlags & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT)
+		alignment = std::max(alignment, limits.minUniformBufferOffsetAlignment);
+	if (usageFlags & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)
+		alignment = std::max(alignment, limits.minStorageBufferOffsetAlignment);
+
+	m_SliceSize = sliceSize;
+	m_SliceStride = (sliceSize + alignment - 1) / alignment * alignment;
+	Init(usageFlags, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, size_t(m_SliceStride * sliceCount), nullptr, nullptr);
+}
+
 Buffer::~Buffer()
 {
 	Cleanup();
@@ -20,99 +39,117 @@ void vkw::Buffer::Update(void * data, size_t size, CommandPool* cmdPool)
 {
 	if(!m_UsingStagingBuffer)
 	{
-		void* pMappedMemory{};
-		ErrorCheck(vkMapMemory(m_pDevice->GetDevice(), m_Memory, 0, VK_WHOLE_SIZE, 0, &pMappedMemory));
-		memcpy(pMappedMemory, data, size);
-		vkUnmapMemory(m_pDevice->GetDevice(), m_Memory);
+		memcpy(m_pMappedMemory, data, size);
 		return;
 	}
-	std::cout << "Warning: Updating a non host visible and host coherent buffer requires a staging buffer which is more performance intensive! Consider using a host visible and host coherent buffer instead!" << std::endl;
 
 	VkBuffer stagingBuffer{};
-	VkDeviceMemory stagingBufferMemory{};
+	Allocation stagingAllocation{};
 	CreateBuffer(
-		m_pDevice->GetDevice(), m_pDevice->GetPhysicalDeviceMemoryProperties(),
+		m_pDevice->GetDevice(), m_pDevice->GetAllocator(),
 		size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		stagingBuffer, stagingBufferMemory
+		stagingBuffer, stagingAllocation
 	);
 
-
-	void* pMappedMemory{};
-	ErrorCheck(vkMapMemory(m_pDevice->GetDevice(), stagingBufferMemory, 0, VK_WHOLE_SIZE, 0, &pMappedMemory));
-	memcpy(pMappedMemory, data, size);
-	vkUnmapMemory(m_pDevice->GetDevice(), stagingBufferMemory);
+	memcpy(stagingAllocation.pMappedData, data, size);
 	
 	CopyBuffer(m_pDevice->GetDevice(), m_pDevice->GetQueue(), cmdPool->GetHandle(), stagingBuffer, m_Buffer, size);
 
-	vkFreeMemory(m_pDevice->GetDevice(), stagingBufferMemory, nullptr);
 	vkDestroyBuffer(m_pDevice->GetDevice(), stagingBuffer, nullptr);
+	m_pDevice->GetAllocator()->Free(stagingAllocation);
 
 }
 
+void vkw::Buffer::Update(const void* data, size_t size, StagingRing* pStagingRing)
+{
+	assert(size <= m_Size && "The data has to fit in the buffer!");
+	if (!m_UsingStagingBuffer)
+	{
+		memcpy(m_pMappedMemory, data, size);
+		return;
+	}
+	pStagingRing->Upload(m_Buffer, 0, data, size);
+}
+
+void vkw::Buffer::UpdateSlice(uint32_t slice, const void* data, size_t size)
+{
+	assert(slice < m_SliceCount && size <= m_SliceSize && "The data has to fit in a slice of the ring!");
+	memcpy(static_cast<char*>(m_pMappedMemory) + GetSliceOffset(slice), data, size);
+}
+
+void vkw::Buffer::Read(void* data, size_t size)
+{
+	assert(!m_UsingStagingBuffer && "Only host visible and host coherent buffers can be read!");
+	memcpy(data, m_pMappedMemory, size);
+}
+
 VkDescriptorBufferInfo vkw::Buffer::GetDescriptor()
 {
 	return m_Descriptor;
 }
 
+uint32_t vkw::Buffer::GetSliceOffset(uint32_t slice) const
+{
+	return uint32_t(slice * m_SliceStride);
+}
+
 void Buffer::Init(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memPropFlags, size_t size, void* data, CommandPool* cmdPool)
 {
 	m_Size = size;
 	m_UsingStagingBuffer = (memPropFlags & (VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) != (VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 	VkBuffer buffer{};
-	VkDeviceMemory bufferMemory{};
+	Allocation bufferAllocation{};
 	if (m_UsingStagingBuffer && data != nullptr) 
 	{
 		CreateBuffer(
-			m_pDevice->GetDevice(), m_pDevice->GetPhysicalDeviceMemoryProperties(),
+			m_pDevice->GetDevice(), m_pDevice->GetAllocator(),
 			size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			buffer, bufferMemory
+			buffer, bufferAllocation
 		);
 	}else
 	{
+		// Device local buffers stay a copy destination so they can be updated later
 		CreateBuffer(
-			m_pDevice->GetDevice(), m_pDevice->GetPhysicalDeviceMemoryProperties(),
-			size, usageFlags, memPropFlags,
-			buffer, bufferMemory
+			m_pDevice->GetDevice(), m_pDevice->GetAllocator(),
+			size, m_UsingStagingBuffer ? usageFlags | VK_BUFFER_USAGE_TRANSFER_DST_BIT : usageFlags, memPropFlags,
+			buffer, bufferAllocation
 		);
 	}
 	if (data != nullptr)
-	{
-		void* pMappedMemory{};
-		ErrorCheck(vkMapMemory(m_pDevice->GetDevice(),bufferMemory, 0, VK_WHOLE_SIZE, 0, &pMappedMemory));
-		memcpy(pMappedMemory, data, size);
-		vkUnmapMemory(m_pDevice->GetDevice(), bufferMemory);
-	}
+		memcpy(bufferAllocation.pMappedData, data, size);
 
 	if (!m_UsingStagingBuffer || data == nullptr) {
 		m_Buffer = buffer;
-		m_Memory = bufferMemory;
+		m_Allocation = bufferAllocation;
+		if (!m_UsingStagingBuffer)
+			m_pMappedMemory = m_Allocation.pMappedData;
 		UpdateDescriptor();
 		return;
 	}
 
 	CreateBuffer(
-		m_pDevice->GetDevice(), m_pDevice->GetPhysicalDeviceMemoryProperties(),
+		m_pDevice->GetDevice(), m_pDevice->GetAllocator(),
 		size, usageFlags | VK_BUFFER_USAGE_TRANSFER_DST_BIT, memPropFlags,
-		m_Buffer, m_Memory
+		m_Buffer, m_Allocation
 	);
 
 	CopyBuffer(m_pDevice->GetDevice(), m_pDevice->GetQueue(), cmdPool->GetHandle(), buffer, m_Buffer, size);
 
-	vkFreeMemory(m_pDevice->GetDevice(), bufferMemory, nullptr);
 	vkDestroyBuffer(m_pDevice->GetDevice(), buffer, nullptr);
+	m_pDevice->GetAllocator()->Free(bufferAllocation);
 
 	UpdateDescriptor();
 }
 
 void vkw::Buffer::Cleanup()
 {
-	vkFreeMemory(m_pDevice->GetDevice(), m_Memory, nullptr);
 	vkDestroyBuffer(m_pDevice->GetDevice(), m_Buffer, nullptr);
+	m_pDevice->GetAllocator()->Free(m_Allocation);
 }
 
 void vkw::Buffer::UpdateDescriptor()
 {
 	m_Descriptor.buffer = m_Buffer;
 	m_Descriptor.offset = 0;
-	m_Descriptor.range = m_Size;
+	m_Descriptor.range = (m_SliceSize > 0) ? m_SliceSize : m_Size;
 }
@@ -1,18 +1,31 @@
 #pragma once
 #include "Platform.h"
+#include "MemoryAllocator.h"
 
 namespace vkw
 {
 	class VulkanDevice;
 	class CommandPool;
+	class StagingRing;
 	class Buffer
 	{
 	public:
 		Buffer(VulkanDevice* pDevice, CommandPool* cmdPool, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memPropFlags, size_t size, void* data);
+		// Host visible ring of sliceCount slices, bound as a dynamic uniform or storage buffer with the offset of a slice.
+		// Every frame in flight writes its own slice, so the host never overwrites data a submitted command buffer still reads.
+		Buffer(VulkanDevice* pDevice, VkBufferUsageFlags usageFlags, size_t sliceSize, uint32_t sliceCount);
 		~Buffer();
 
+		// Blocks until the copy finished when the buffer is not host visible, use the staging ring for updates every frame
 		void Update(void * data, size_t size, CommandPool* cmdPool);
+		// Device local buffers are copied to by the next flush of the ring, host visible ones are written directly
+		void Update(const void* data, size_t size, StagingRing* pStagingRing);
+		void UpdateSlice(uint32_t slice, const void* data, size_t size);
+		// Copies the start of the buffer back to the host, only possible for host visible and host coherent buffers
+		void Read(void* data, size_t size);
+		// Covers a single slice for ring buffers
 		VkDescriptorBufferInfo GetDescriptor();
+		uint32_t GetSliceOffset(uint32_t slice) const;
 
 	private:
 		void Init(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memPropFlags, size_t size, void* data, CommandPool* cmdPool);
@@ -21,10 +34,15 @@ namespace vkw
 
 		VulkanDevice*						m_pDevice = nullptr;
 		VkBuffer							m_Buffer = VK_NULL_HANDLE;
-		VkDeviceMemory						m_Memory = VK_NULL_HANDLE;
+		Allocation							m_Allocation{};
 		VkDescriptorBufferInfo				m_Descriptor{};
 		VkDeviceSize						m_Size{};
 		bool								m_UsingStagingBuffer{ false };
+		// Host visible buffers stay mapped for their lifetime, points into the mapped allocation
+		void*								m_pMappedMemory = nullptr;
+		VkDeviceSize						m_SliceSize{};
+		VkDeviceSize						m_SliceStride{};
+		uint32_t							m_SliceCount{ 1 };
 	};
 }
 
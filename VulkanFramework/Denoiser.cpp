@@ -0,0 +1,165 @@
+#include "Denoiser.h"
+#include "VulkanHelpers.h"
+#include "VulkanDevice.h"
+#include "Texture.h"
+#include "Shader.h"
+#include "Helper.h"
+
+Denoiser::Denoiser(vkw::VulkanDevice* pDevice, vkw::CommandPool* pCommandPool, VkDescriptorSetLayout sceneSetLayout, uint32_t width, uint32_t height)
+	:m_pDevice(pDevice)
+	,m_Width(width)
+	,m_Height(height)
+	,m_TraceWidth(width)
+	,m_TraceHeight(height)
+{
+	for (vkw::Texture*& pImage : m_pImages)
+	{
+		pImage = new vkw::Texture(m_pDevice, pCommandPool, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_LAYOUT_GENERAL, nullptr, m_Width, m_Height, 1, VK_FORMAT_R32G32B32A32_SFLOAT);
+	}
+	CreateDescriptorSets();
+	CreatePipeline(sceneSetLayout);
+}
+
+Denoiser::~Denoiser()
+{
+	vkDestroyPipeline(m_pDevice->GetDevice(), m_Pipeline, nullptr);
+	vkDestroyPipelineLayout(m_pDevice->GetDevice(), m_PipelineLayout, nullptr);
+	vkDestroyDescriptorPool(m_pDevice->GetDevice(), m_DescriptorPool, nullptr);
+	vkDestroyDescriptorSetLayout(m_pDevice->GetDevice(), m_DescriptorSetLayout, nullptr);
+
+	for (vkw::Texture* pImage : m_pImages)
+	{
+		delete pImage;
+	}
+}
+
+void Denoiser::RecordDenoise(VkCommandBuffer commandBuffer, VkDescriptorSet sceneSet, uint32_t uniformOffset)
+{
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_Pipeline);
+	for (uint32_t iteration = 0; iteration < IterationCount; iteration++)
+	{
+		// Waits for the trace before the first iteration and for the previous iteration before the others
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		std::array<VkDescriptorSet, 2> descriptorSets{ sceneSet, m_DescriptorSets[iteration % 2] };
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_PipelineLayout, 0, descriptorSets.size(), descriptorSets.data(), 1, &uniformOffset);
+
+		PushConstants pushConstants{ iteration, 1u << iteration, m_ColorPhi, m_NormalPhi, m_DepthPhi };
+		vkCmdPushConstants(commandBuffer, m_PipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+		vkCmdDispatch(commandBuffer, (m_TraceWidth + WorkGroupSize - 1) / WorkGroupSize, (m_TraceHeight + WorkGroupSize - 1) / WorkGroupSize, 1);
+	}
+}
+
+vkw::Texture* Denoiser::GetOutput()
+{
+	return m_pImages[(IterationCount - 1) % 2];
+}
+
+void Denoiser::SetTraceSize(uint32_t width, uint32_t height)
+{
+	m_TraceWidth = width;
+	m_TraceHeight = height;
+}
+
+void Denoiser::CreateDescriptorSets()
+{
+	const uint32_t bindingCount{ 2 };
+	std::array<VkDescriptorSetLayoutBinding, bindingCount> setLayoutBindings{};
+	for (uint32_t i = 0; i < bindingCount; i++)
+	{
+		setLayoutBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		setLayoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		setLayoutBindings[i].binding = i;
+		setLayoutBindings[i].descriptorCount = 1;
+	}
+
+	VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo{};
+	descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	descriptorSetLayoutCreateInfo.pBindings = setLayoutBindings.data();
+	descriptorSetLayoutCreateInfo.bindingCount = setLayoutBindings.size();
+
+	ErrorCheck(vkCreateDescriptorSetLayout(m_pDevice->GetDevice(), &descriptorSetLayoutCreateInfo, nullptr, &m_DescriptorSetLayout));
+
+	VkDescriptorPoolSize poolSize{};
+	poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	poolSize.descriptorCount = bindingCount * m_DescriptorSets.size();
+
+	VkDescriptorPoolCreateInfo descriptorPoolInfo{};
+	descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptorPoolInfo.poolSizeCount = 1;
+	descriptorPoolInfo.pPoolSizes = &poolSize;
+	descriptorPoolInfo.maxSets = m_DescriptorSets.size();
+
+	ErrorCheck(vkCreateDescriptorPool(m_pDevice->GetDevice(), &descriptorPoolInfo, nullptr, &m_DescriptorPool));
+
+	std::array<VkDescriptorSetLayout, 2> setLayouts{ m_DescriptorSetLayout, m_DescriptorSetLayout };
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = m_DescriptorPool;
+	allocInfo.pSetLayouts = setLayouts.data();
+	allocInfo.descriptorSetCount = setLayouts.size();
+
+	ErrorCheck(vkAllocateDescriptorSets(m_pDevice->GetDevice(), &allocInfo, m_DescriptorSets.data()));
+
+	// Binding 0 is the input and binding 1 the output of set 1 in denoise.comp
+	for (uint32_t set = 0; set < m_DescriptorSets.size(); set++)
+	{
+		std::array<VkDescriptorImageInfo, bindingCount> imageInfos{
+			m_pImages[1 - set]->GetDescriptor(),
+			m_pImages[set]->GetDescriptor()
+		};
+
+		std::array<VkWriteDescriptorSet, bindingCount> writeDescriptorSets{};
+		for (uint32_t i = 0; i < bindingCount; i++)
+		{
+			writeDescriptorSets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writeDescriptorSets[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			writeDescriptorSets[i].descriptorCount = 1;
+			writeDescriptorSets[i].dstBinding = i;
+			writeDescriptorSets[i].dstSet = m_DescriptorSets[set];
+			writeDescriptorSets[i].pImageInfo = &imageInfos[i];
+		}
+		vkUpdateDescriptorSets(m_pDevice->GetDevice(), writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
+	}
+}
+
+void Denoiser::CreatePipeline(VkDescriptorSetLayout sceneSetLayout)
+{
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(PushConstants);
+
+	std::array<VkDescriptorSetLayout, 2> setLayouts{ sceneSetLayout, m_DescriptorSetLayout };
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{};
+	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutCreateInfo.pSetLayouts = setLayouts.data();
+	pipelineLayoutCreateInfo.setLayoutCount = setLayouts.size();
+	pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+	pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+
+	ErrorCheck(vkCreatePipelineLayout(m_pDevice->GetDevice(), &pipelineLayoutCreateInfo, nullptr, &m_PipelineLayout));
+
+	VkShaderModule shaderModule = CreateShaderModule(readFile("Shaders/denoise.comp.spv"), m_pDevice->GetDevice());
+
+	VkPipelineShaderStageCreateInfo shaderStageInfo{};
+	shaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	shaderStageInfo.module = shaderModule;
+	shaderStageInfo.pName = "main";
+
+	VkComputePipelineCreateInfo computePipelineCreateInfo{};
+	computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	computePipelineCreateInfo.layout = m_PipelineLayout;
+	computePipelineCreateInfo.flags = 0;
+	computePipelineCreateInfo.stage = shaderStageInfo;
+
+	ErrorCheck(vkCreateComputePipelines(m_pDevice->GetDevice(), VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &m_Pipeline));
+
+	vkDestroyShaderModule(m_pDevice->GetDevice(), shaderModule, nullptr);
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "Platform.h"
+#include <array>
+
+namespace vkw
+{
+	class VulkanDevice;
+	class CommandPool;
+	class Texture;
+}
+
+// Edge avoiding a-trous wavelet filter (Dammertz 2010) with the variance guided luminance weights of SVGF (Schied 2017).
+// Every iteration filters with a 5x5 kernel whose taps are twice as far apart as in the previous one, the edges are kept by the
+// primary hit normal, depth and material the tracers write to the feature buffer. The variance of the mean comes from the accumulated
+// luminance moments and is filtered along with the color, so converged regions are blurred less every frame.
+// The scene is read through the descriptor set of the megakernel, which is bound as set 0.
+class Denoiser
+{
+public:
+	Denoiser(vkw::VulkanDevice* pDevice, vkw::CommandPool* pCommandPool, VkDescriptorSetLayout sceneSetLayout, uint32_t width, uint32_t height);
+	~Denoiser();
+
+	// Records every iteration, it has to follow the trace in the same command buffer
+	void RecordDenoise(VkCommandBuffer commandBuffer, VkDescriptorSet sceneSet, uint32_t uniformOffset);
+	// Image the last iteration writes, copied to the display image of the frame while denoising is enabled
+	vkw::Texture* GetOutput();
+	// Only the traced rectangle is filtered, the command buffers have to be recorded again after it changed
+	void SetTraceSize(uint32_t width, uint32_t height);
+
+	static const uint32_t	WorkGroupSize{ 16 };
+	static const uint32_t	IterationCount{ 5 };
+
+private:
+	struct PushConstants
+	{
+		uint32_t iteration;
+		uint32_t stepWidth;
+		float colorPhi;
+		float normalPhi;
+		float depthPhi;
+	};
+
+	void CreateDescriptorSets();
+	void CreatePipeline(VkDescriptorSetLayout sceneSetLayout);
+
+	vkw::VulkanDevice*					m_pDevice = nullptr;
+	uint32_t							m_Width{};
+	uint32_t							m_Height{};
+	uint32_t							m_TraceWidth{};
+	uint32_t							m_TraceHeight{};
+
+	// Luminance differences are divided by colorPhi times the standard deviation, normal and depth weights get sharper with higher normalPhi and lower depthPhi
+	float								m_ColorPhi{ 4.f };
+	float								m_NormalPhi{ 128.f };
+	float								m_DepthPhi{ 1.f };
+
+	// Color of the filtered image with its variance in w, iterations ping pong between them
+	std::array<vkw::Texture*, 2>		m_pImages{};
+
+	VkDescriptorPool					m_DescriptorPool = VK_NULL_HANDLE;
+	VkDescriptorSetLayout				m_DescriptorSetLayout = VK_NULL_HANDLE;
+	// Set i writes image i and reads the other one
+	std::array<VkDescriptorSet, 2>		m_DescriptorSets{};
+	VkPipelineLayout					m_PipelineLayout = VK_NULL_HANDLE;
+	VkPipeline							m_Pipeline = VK_NULL_HANDLE;
+};
@@ -87,18 +87,7 @@ void DepthStencilBuffer::Init()
 
 	ErrorCheck(vkCreateImage(m_pDevice->GetDevice(), &imageCreateInfo, nullptr, &m_Image));
 
-	VkMemoryRequirements imageMemoryRequirements{};
-	vkGetImageMemoryRequirements(m_pDevice->GetDevice(), m_Image, &imageMemoryRequirements);
-
-	uint32_t memoryIndex = FindMemoryTypeIndex(&m_pDevice->GetPhysicalDeviceMemoryProperties(), &imageMemoryRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-	VkMemoryAllocateInfo memoryAllocateInfo{};
-	memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memoryAllocateInfo.allocationSize = imageMemoryRequirements.size;
-	memoryAllocateInfo.memoryTypeIndex =
-
-	vkAllocateMemory(m_pDevice->GetDevice(), &memoryAllocateInfo, nullptr, &m_ImageMemory);
-	vkBindImageMemory(m_pDevice->GetDevice(), m_Image, m_ImageMemory, 0);
+	m_Allocation = m_pDevice->GetAllocator()->AllocateImageMemory(m_Image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
 	VkImageViewCreateInfo imageViewCreateInfo{};
 	imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -121,6 +110,6 @@ void DepthStencilBuffer::Init()
 void DepthStencilBuffer::Cleanup()
 {
 	vkDestroyImageView(m_pDevice->GetDevice(), m_ImageView, nullptr);
-	vkFreeMemory(m_pDevice->GetDevice(), m_ImageMemory, nullptr);
 	vkDestroyImage(m_pDevice->GetDevice(), m_Image, nullptr);
+	m_pDevice->GetAllocator()->Free(m_Allocation);
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include "Platform.h"
+#include "MemoryAllocator.h"
 
 namespace vkw
 {
@@ -26,7 +27,7 @@ namespace vkw
 		bool				m_StencilAvailable{false};
 		VkImage				m_Image = VK_NULL_HANDLE;
 		VkImageView			m_ImageView = VK_NULL_HANDLE;
-		VkDeviceMemory		m_ImageMemory = VK_NULL_HANDLE;
+		Allocation			m_Allocation{};
 	};
 }
 
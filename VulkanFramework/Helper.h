@@ -2,7 +2,7 @@
 #include <vector>
 #include <fstream>
 
-std::vector<char> readFile(const std::string& filename)
+inline std::vector<char> readFile(const std::string& filename)
 {
 	std::ifstream file(filename, std::ios::ate | std::ios::binary); //ate makes it so you start reading at the end of the file handy for knowing filesize.
 	if(!file.is_open())
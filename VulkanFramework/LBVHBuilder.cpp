@@ -0,0 +1,233 @@
+#include "LBVHBuilder.h"
+#include "VulkanHelpers.h"
+#include "VulkanDevice.h"
+#include "Buffer.h"
+#include "Shader.h"
+#include "Helper.h"
+#include <algorithm>
+#include <cassert>
+#include <string>
+
+LBVHBuilder::LBVHBuilder(vkw::VulkanDevice* pDevice, vkw::CommandPool* pCommandPool, vkw::Buffer* pSphereBuffer, vkw::Buffer* pNodeBuffer, uint32_t sphereCount)
+	:m_pDevice(pDevice)
+	,m_PrimitiveCount(sphereCount)
+	,m_BlockCount((sphereCount + WorkGroupSize - 1) / WorkGroupSize)
+{
+	assert(sphereCount > 0 && "Can't build a bvh without primitives!");
+	CreateBuffers(pCommandPool);
+	CreateDescriptorSets(pSphereBuffer, pNodeBuffer);
+	CreatePipelines();
+}
+
+LBVHBuilder::~LBVHBuilder()
+{
+	for (VkPipeline pipeline : m_Pipelines)
+	{
+		vkDestroyPipeline(m_pDevice->GetDevice(), pipeline, nullptr);
+	}
+	vkDestroyPipelineLayout(m_pDevice->GetDevice(), m_PipelineLayout, nullptr);
+	vkDestroyDescriptorPool(m_pDevice->GetDevice(), m_DescriptorPool, nullptr);
+	vkDestroyDescriptorSetLayout(m_pDevice->GetDevice(), m_DescriptorSetLayout, nullptr);
+
+	delete m_pPrimitiveBoundsBuffer;
+	delete m_pSceneBoundsBuffer;
+	for (int i = 0; i < 2; i++)
+	{
+		delete m_pKeyBuffers[i];
+		delete m_pValueBuffers[i];
+	}
+	delete m_pHistogramBuffer;
+	delete m_pParentBuffer;
+	delete m_pFlagBuffer;
+}
+
+void LBVHBuilder::RecordBuild(VkCommandBuffer commandBuffer)
+{
+	// The previous build and the shaders reading it have to be done before the scratch buffers are reset
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+	// Scene bounds are reduced with atomicMin/atomicMax on order preserving uints
+	VkBuffer sceneBounds = m_pSceneBoundsBuffer->GetDescriptor().buffer;
+	vkCmdFillBuffer(commandBuffer, sceneBounds, 0, 3 * sizeof(uint32_t), 0xFFFFFFFF);
+	vkCmdFillBuffer(commandBuffer, sceneBounds, 3 * sizeof(uint32_t), 3 * sizeof(uint32_t), 0);
+	vkCmdFillBuffer(commandBuffer, m_pParentBuffer->GetDescriptor().buffer, 0, VK_WHOLE_SIZE, 0xFFFFFFFF);
+	vkCmdFillBuffer(commandBuffer, m_pFlagBuffer->GetDescriptor().buffer, 0, VK_WHOLE_SIZE, 0);
+	RecordBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+	RecordDispatch(commandBuffer, BoundsPass, 0, 0, m_BlockCount);
+	RecordBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+	RecordDispatch(commandBuffer, MortonPass, 0, 0, m_BlockCount);
+	RecordBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+
+	// An even amount of passes leaves the sorted keys and values in the first buffers
+	for (uint32_t pass = 0; pass < RadixPassCount; pass++)
+	{
+		uint32_t shift = pass * 8;
+		RecordDispatch(commandBuffer, RadixCountPass, pass % 2, shift, m_BlockCount);
+		RecordBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+		RecordDispatch(commandBuffer, RadixScanPass, pass % 2, shift, 1);
+		RecordBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+		RecordDispatch(commandBuffer, RadixScatterPass, pass % 2, shift, m_BlockCount);
+		RecordBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+	}
+
+	RecordDispatch(commandBuffer, HierarchyPass, 0, 0, m_BlockCount);
+	RecordBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+	RecordDispatch(commandBuffer, RefitPass, 0, 0, m_BlockCount);
+	RecordBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+}
+
+void LBVHBuilder::CreateBuffers(vkw::CommandPool* pCommandPool)
+{
+	const VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	m_pPrimitiveBoundsBuffer = new vkw::Buffer(m_pDevice, pCommandPool, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, size_t(m_PrimitiveCount) * 2 * sizeof(glm::vec4), nullptr);
+	m_pSceneBoundsBuffer = new vkw::Buffer(m_pDevice, pCommandPool, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 6 * sizeof(uint32_t), nullptr);
+	for (int i = 0; i < 2; i++)
+	{
+		m_pKeyBuffers[i] = new vkw::Buffer(m_pDevice, pCommandPool, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, size_t(m_PrimitiveCount) * sizeof(uint32_t), nullptr);
+		m_pValueBuffers[i] = new vkw::Buffer(m_pDevice, pCommandPool, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, size_t(m_PrimitiveCount) * sizeof(uint32_t), nullptr);
+	}
+	// Digit major so one exclusive scan gives every block its scatter offset per digit
+	m_pHistogramBuffer = new vkw::Buffer(m_pDevice, pCommandPool, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, size_t(RadixSize) * m_BlockCount * sizeof(uint32_t), nullptr);
+	m_pParentBuffer = new vkw::Buffer(m_pDevice, pCommandPool, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, size_t(m_PrimitiveCount * 2 - 1) * sizeof(uint32_t), nullptr);
+	// One arrival counter per internal node, a single sphere has none but the buffer can't be empty
+	m_pFlagBuffer = new vkw::Buffer(m_pDevice, pCommandPool, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, size_t(std::max(m_PrimitiveCount - 1, 1u)) * sizeof(uint32_t), nullptr);
+}
+
+void LBVHBuilder::CreateDescriptorSets(vkw::Buffer* pSphereBuffer, vkw::Buffer* pNodeBuffer)
+{
+	const uint32_t bindingCount{ 11 };
+	std::array<VkDescriptorSetLayoutBinding, bindingCount> setLayoutBindings{};
+	for (uint32_t i = 0; i < bindingCount; i++)
+	{
+		setLayoutBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		setLayoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		setLayoutBindings[i].binding = i;
+		setLayoutBindings[i].descriptorCount = 1;
+	}
+
+	VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo{};
+	descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	descriptorSetLayoutCreateInfo.pBindings = setLayoutBindings.data();
+	descriptorSetLayoutCreateInfo.bindingCount = setLayoutBindings.size();
+
+	ErrorCheck(vkCreateDescriptorSetLayout(m_pDevice->GetDevice(), &descriptorSetLayoutCreateInfo, nullptr, &m_DescriptorSetLayout));
+
+	VkDescriptorPoolSize poolSize{};
+	poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSize.descriptorCount = bindingCount * m_DescriptorSets.size();
+
+	VkDescriptorPoolCreateInfo descriptorPoolInfo{};
+	descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptorPoolInfo.poolSizeCount = 1;
+	descriptorPoolInfo.pPoolSizes = &poolSize;
+	descriptorPoolInfo.maxSets = m_DescriptorSets.size();
+
+	ErrorCheck(vkCreateDescriptorPool(m_pDevice->GetDevice(), &descriptorPoolInfo, nullptr, &m_DescriptorPool));
+
+	std::array<VkDescriptorSetLayout, 2> setLayouts{ m_DescriptorSetLayout, m_DescriptorSetLayout };
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = m_DescriptorPool;
+	allocInfo.pSetLayouts = setLayouts.data();
+	allocInfo.descriptorSetCount = setLayouts.size();
+
+	ErrorCheck(vkAllocateDescriptorSets(m_pDevice->GetDevice(), &allocInfo, m_DescriptorSets.data()));
+
+	for (uint32_t set = 0; set < 2; set++)
+	{
+		// Binding order matches lbvh.comp
+		std::array<VkDescriptorBufferInfo, bindingCount> bufferInfos{
+			pSphereBuffer->GetDescriptor(),
+			pNodeBuffer->GetDescriptor(),
+			m_pPrimitiveBoundsBuffer->GetDescriptor(),
+			m_pSceneBoundsBuffer->GetDescriptor(),
+			m_pKeyBuffers[set]->GetDescriptor(),
+			m_pValueBuffers[set]->GetDescriptor(),
+			m_pKeyBuffers[1 - set]->GetDescriptor(),
+			m_pValueBuffers[1 - set]->GetDescriptor(),
+			m_pHistogramBuffer->GetDescriptor(),
+			m_pParentBuffer->GetDescriptor(),
+			m_pFlagBuffer->GetDescriptor()
+		};
+
+		std::array<VkWriteDescriptorSet, bindingCount> writeDescriptorSets{};
+		for (uint32_t i = 0; i < bindingCount; i++)
+		{
+			writeDescriptorSets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writeDescriptorSets[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writeDescriptorSets[i].descriptorCount = 1;
+			writeDescriptorSets[i].dstBinding = i;
+			writeDescriptorSets[i].dstSet = m_DescriptorSets[set];
+			writeDescriptorSets[i].pBufferInfo = &bufferInfos[i];
+		}
+		vkUpdateDescriptorSets(m_pDevice->GetDevice(), writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
+	}
+}
+
+void LBVHBuilder::CreatePipelines()
+{
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(PushConstants);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{};
+	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutCreateInfo.pSetLayouts = &m_DescriptorSetLayout;
+	pipelineLayoutCreateInfo.setLayoutCount = 1;
+	pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+	pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+
+	ErrorCheck(vkCreatePipelineLayout(m_pDevice->GetDevice(), &pipelineLayoutCreateInfo, nullptr, &m_PipelineLayout));
+
+	// Every pass is compiled from lbvh.comp with its own define, see generate-spirv.bat
+	const std::array<std::string, PassCount> shaderFiles{
+		"Shaders/lbvh_bounds.comp.spv",
+		"Shaders/lbvh_morton.comp.spv",
+		"Shaders/lbvh_radix_count.comp.spv",
+		"Shaders/lbvh_radix_scan.comp.spv",
+		"Shaders/lbvh_radix_scatter.comp.spv",
+		"Shaders/lbvh_hierarchy.comp.spv",
+		"Shaders/lbvh_refit.comp.spv"
+	};
+
+	for (uint32_t pass = 0; pass < PassCount; pass++)
+	{
+		VkShaderModule shaderModule = CreateShaderModule(readFile(shaderFiles[pass]), m_pDevice->GetDevice());
+
+		VkPipelineShaderStageCreateInfo shaderStageInfo{};
+		shaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		shaderStageInfo.module = shaderModule;
+		shaderStageInfo.pName = "main";
+
+		VkComputePipelineCreateInfo computePipelineCreateInfo{};
+		computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		computePipelineCreateInfo.layout = m_PipelineLayout;
+		computePipelineCreateInfo.flags = 0;
+		computePipelineCreateInfo.stage = shaderStageInfo;
+
+		ErrorCheck(vkCreateComputePipelines(m_pDevice->GetDevice(), VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &m_Pipelines[pass]));
+
+		vkDestroyShaderModule(m_pDevice->GetDevice(), shaderModule, nullptr);
+	}
+}
+
+void LBVHBuilder::RecordDispatch(VkCommandBuffer commandBuffer, Pass pass, uint32_t sortDirection, uint32_t shift, uint32_t groupCount)
+{
+	PushConstants pushConstants{ m_PrimitiveCount, shift, m_BlockCount };
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_Pipelines[pass]);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_PipelineLayout, 0, 1, &m_DescriptorSets[sortDirection], 0, 0);
+	vkCmdPushConstants(commandBuffer, m_PipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+	vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+}
+
+void LBVHBuilder::RecordBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess)
+{
+	VkMemoryBarrier memoryBarrier{};
+	memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memoryBarrier.srcAccessMask = srcAccess;
+	memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, srcStage, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+}
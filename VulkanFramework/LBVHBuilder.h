@@ -0,0 +1,73 @@
+#pragma once
+#include "Platform.h"
+#include <array>
+
+namespace vkw
+{
+	class VulkanDevice;
+	class CommandPool;
+	class Buffer;
+}
+
+// Builds a linear bvh (Karras 2012) over the sphere buffer entirely on the gpu:
+// scene bounds, 30 bit morton codes of the centroids, an 8 bit radix sort, hierarchy emission and a bottom up bounds pass.
+// The node buffer needs room for 2n-1 nodes, internal nodes come first with the root at 0, every leaf holds a single sphere.
+// Only plain compute features are used (no subgroup operations or float atomics) so it also runs on software drivers like lavapipe.
+class LBVHBuilder
+{
+public:
+	LBVHBuilder(vkw::VulkanDevice* pDevice, vkw::CommandPool* pCommandPool, vkw::Buffer* pSphereBuffer, vkw::Buffer* pNodeBuffer, uint32_t sphereCount);
+	~LBVHBuilder();
+
+	// Records the complete rebuild, the nodes are ready to be read by compute shaders recorded afterwards
+	void RecordBuild(VkCommandBuffer commandBuffer);
+
+	static const uint32_t	WorkGroupSize{ 256 };
+	static const uint32_t	RadixSize{ 256 };
+	static const uint32_t	RadixPassCount{ 4 };
+
+private:
+	enum Pass
+	{
+		BoundsPass,
+		MortonPass,
+		RadixCountPass,
+		RadixScanPass,
+		RadixScatterPass,
+		HierarchyPass,
+		RefitPass,
+		PassCount
+	};
+
+	struct PushConstants
+	{
+		uint32_t primitiveCount;
+		uint32_t shift;
+		uint32_t blockCount;
+	};
+
+	void CreateBuffers(vkw::CommandPool* pCommandPool);
+	void CreateDescriptorSets(vkw::Buffer* pSphereBuffer, vkw::Buffer* pNodeBuffer);
+	void CreatePipelines();
+	void RecordDispatch(VkCommandBuffer commandBuffer, Pass pass, uint32_t sortDirection, uint32_t shift, uint32_t groupCount);
+	void RecordBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess);
+
+	vkw::VulkanDevice*					m_pDevice = nullptr;
+	uint32_t							m_PrimitiveCount{};
+	uint32_t							m_BlockCount{};
+
+	vkw::Buffer*						m_pPrimitiveBoundsBuffer = nullptr;
+	vkw::Buffer*						m_pSceneBoundsBuffer = nullptr;
+	std::array<vkw::Buffer*, 2>			m_pKeyBuffers{};
+	std::array<vkw::Buffer*, 2>			m_pValueBuffers{};
+	vkw::Buffer*						m_pHistogramBuffer = nullptr;
+	vkw::Buffer*						m_pParentBuffer = nullptr;
+	vkw::Buffer*						m_pFlagBuffer = nullptr;
+
+	VkDescriptorPool					m_DescriptorPool = VK_NULL_HANDLE;
+	VkDescriptorSetLayout				m_DescriptorSetLayout = VK_NULL_HANDLE;
+	// The radix sort ping pongs between the key and value buffers, the second set has the in and out buffers swapped
+	std::array<VkDescriptorSet, 2>		m_DescriptorSets{};
+	VkPipelineLayout					m_PipelineLayout = VK_NULL_HANDLE;
+	std::array<VkPipeline, PassCount>	m_Pipelines{};
+};
@@ -3,12 +3,54 @@
 #include "VulkanApp.h"
 #include <chrono>
 #include <iostream>
+#include <string>
 
 
-int main()
+int main(int argc, char* argv[])
 {
+	// --bvh-benchmark [model.obj] only measures the bvh build on the cpu and exits
+	if (argc > 1 && std::string(argv[1]) == "--bvh-benchmark")
+	{
+		VulkanApp::RunBVHBenchmark((argc > 2) ? argv[2] : "Models/Teapot.obj");
+		return 0;
+	}
+
+	// --autotune benchmarks the trace kernel configurations before the first frame and caches the fastest for this device
+	// --target-frame-time [ms] sets the gpu time per frame the dynamic resolution scaling aims for
+	// --frames-in-flight [count] sets how many frames the cpu records ahead of the gpu
+	// --gpu-sphere-bvh builds the sphere bvh on the gpu instead of the SAH and wide bvh of the cpu
+	// --animate-spheres moves the spheres from the first frame on, G toggles it at runtime
+	// --precomputed-triangles traces triangles with precomputed edges instead of indexing the shared vertex buffer
+	bool autotune{ false };
+	float targetFrameTime{ 16.6f };
+	uint32_t framesInFlight{ 2 };
+	bool gpuSphereBVH{ false };
+	bool animateSpheres{ false };
+	bool precomputedTriangles{ false };
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::string(argv[i]) == "--autotune")
+			autotune = true;
+		else if (std::string(argv[i]) == "--target-frame-time" && i + 1 < argc)
+			targetFrameTime = std::stof(argv[++i]);
+		else if (std::string(argv[i]) == "--frames-in-flight" && i + 1 < argc)
+			framesInFlight = std::stoul(argv[++i]);
+		else if (std::string(argv[i]) == "--gpu-sphere-bvh")
+			gpuSphereBVH = true;
+		else if (std::string(argv[i]) == "--animate-spheres")
+			animateSpheres = true;
+		else if (std::string(argv[i]) == "--precomputed-triangles")
+			precomputedTriangles = true;
+	}
+
 	vkw::VulkanDevice device{};
 	VulkanApp app(&device);
+	app.SetAutotune(autotune);
+	app.SetTargetFrameTime(targetFrameTime);
+	app.SetFramesInFlight(framesInFlight);
+	app.SetGPUSphereBVH(gpuSphereBVH);
+	app.SetAnimateSpheres(animateSpheres);
+	app.SetPrecomputedTriangles(precomputedTriangles);
 	app.Init(1280, 720);
 	std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
 	int frames{};
@@ -0,0 +1,269 @@
+#include "MemoryAllocator.h"
+#include "VulkanDevice.h"
+#include "VulkanHelpers.h"
+#include <cassert>
+#include <iostream>
+using namespace vkw;
+
+MemoryAllocator::MemoryAllocator(VulkanDevice* pDevice)
+	:m_pDevice(pDevice)
+{
+	while ((MinAllocationSize << m_MaxOrder) < BlockSize)
+	{
+		m_MaxOrder++;
+	}
+
+	// Buddy ranges are aligned to their power of two size, so with a granularity up to the smallest range
+	// a linear and an optimal resource never end up in the same page
+	m_SeparateOptimalImages = m_pDevice->GetPhysicalDeviceProperties().limits.bufferImageGranularity > MinAllocationSize;
+
+	const uint32_t memoryTypeCount = m_pDevice->GetPhysicalDeviceMemoryProperties().memoryTypeCount;
+	m_Pools.resize(m_SeparateOptimalImages ? memoryTypeCount * 2 : memoryTypeCount);
+	for (uint32_t i = 0; i < m_Pools.size(); i++)
+	{
+		m_Pools[i].memoryType = i % memoryTypeCount;
+	}
+}
+
+MemoryAllocator::~MemoryAllocator()
+{
+	if (m_AllocationCount > 0)
+		std::cout << "Warning: " << m_AllocationCount << " device memory allocations were not freed before the allocator was destroyed!" << std::endl;
+	for (Pool& pool : m_Pools)
+	{
+		for (Block& block : pool.blocks)
+		{
+			DestroyBlock(block);
+		}
+	}
+}
+
+Allocation MemoryAllocator::AllocateBufferMemory(VkBuffer buffer, VkMemoryPropertyFlags properties)
+{
+	VkMemoryDedicatedRequirements dedicatedRequirements{};
+	dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+	VkMemoryRequirements2 requirements{};
+	requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+	requirements.pNext = &dedicatedRequirements;
+	VkBufferMemoryRequirementsInfo2 requirementsInfo{};
+	requirementsInfo.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+	requirementsInfo.buffer = buffer;
+	vkGetBufferMemoryRequirements2(m_pDevice->GetDevice(), &requirementsInfo, &requirements);
+
+	const bool dedicated = dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
+	Allocation allocation = Allocate(requirements.memoryRequirements, properties, true, dedicated, buffer, VK_NULL_HANDLE);
+	ErrorCheck(vkBindBufferMemory(m_pDevice->GetDevice(), buffer, allocation.memory, allocation.offset));
+	return allocation;
+}
+
+Allocation MemoryAllocator::AllocateImageMemory(VkImage image, VkMemoryPropertyFlags properties, bool linearTiling)
+{
+	VkMemoryDedicatedRequirements dedicatedRequirements{};
+	dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+	VkMemoryRequirements2 requirements{};
+	requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+	requirements.pNext = &dedicatedRequirements;
+	VkImageMemoryRequirementsInfo2 requirementsInfo{};
+	requirementsInfo.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+	requirementsInfo.image = image;
+	vkGetImageMemoryRequirements2(m_pDevice->GetDevice(), &requirementsInfo, &requirements);
+
+	const bool dedicated = dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
+	Allocation allocation = Allocate(requirements.memoryRequirements, properties, linearTiling, dedicated, VK_NULL_HANDLE, image);
+	ErrorCheck(vkBindImageMemory(m_pDevice->GetDevice(), image, allocation.memory, allocation.offset));
+	return allocation;
+}
+
+void MemoryAllocator::Free(Allocation& allocation)
+{
+	if (allocation.memory == VK_NULL_HANDLE)
+		return;
+
+	m_AllocationCount--;
+	m_UsedBytes -= allocation.size;
+	if (allocation.pool == UINT32_MAX)
+	{
+		// Freeing the memory unmaps it as well
+		vkFreeMemory(m_pDevice->GetDevice(), allocation.memory, nullptr);
+		m_DedicatedAllocationCount--;
+		m_DedicatedBytes -= allocation.size;
+		allocation = Allocation{};
+		return;
+	}
+
+	Pool& pool = m_Pools[allocation.pool];
+	for (size_t i = 0; i < pool.blocks.size(); i++)
+	{
+		Block& block = pool.blocks[i];
+		if (block.memory != allocation.memory)
+			continue;
+
+		FreeToBlock(block, allocation.offset, allocation.order);
+		// One empty block is kept per pool so allocations that come and go every frame don't reallocate it
+		if (IsEmpty(block) && pool.blocks.size() > 1)
+		{
+			DestroyBlock(block);
+			pool.blocks.erase(pool.blocks.begin() + i);
+		}
+		allocation = Allocation{};
+		return;
+	}
+	assert(0 && "The allocation does not belong to this allocator!");
+}
+
+MemoryStats MemoryAllocator::GetStats() const
+{
+	MemoryStats stats{};
+	for (const Pool& pool : m_Pools)
+	{
+		stats.blockCount += uint32_t(pool.blocks.size());
+	}
+	stats.dedicatedAllocationCount = m_DedicatedAllocationCount;
+	stats.allocationCount = m_AllocationCount;
+	stats.reservedBytes = stats.blockCount * BlockSize + m_DedicatedBytes;
+	stats.usedBytes = m_UsedBytes;
+	return stats;
+}
+
+Allocation MemoryAllocator::Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool linear, bool dedicated, VkBuffer buffer, VkImage image)
+{
+	const uint32_t memoryType = FindMemoryTypeIndex(&m_pDevice->GetPhysicalDeviceMemoryProperties(), &requirements, properties);
+	if (dedicated || requirements.size >= DedicatedThreshold || requirements.alignment > BlockSize)
+		return AllocateDedicated(memoryType, requirements.size, buffer, image);
+
+	// The smallest power of two range that holds the resource also satisfies its alignment
+	uint32_t order{ 0 };
+	while ((MinAllocationSize << order) < requirements.size || (MinAllocationSize << order) < requirements.alignment)
+	{
+		order++;
+	}
+
+	const uint32_t poolIndex = (m_SeparateOptimalImages && !linear) ? memoryType + m_pDevice->GetPhysicalDeviceMemoryProperties().memoryTypeCount : memoryType;
+	Pool& pool = m_Pools[poolIndex];
+	VkDeviceSize offset{};
+	Block* pBlock = nullptr;
+	for (Block& block : pool.blocks)
+	{
+		if (AllocateFromBlock(block, order, offset))
+		{
+			pBlock = &block;
+			break;
+		}
+	}
+	if (pBlock == nullptr)
+	{
+		pool.blocks.push_back(CreateBlock(memoryType));
+		pBlock = &pool.blocks.back();
+		AllocateFromBlock(*pBlock, order, offset);
+	}
+
+	Allocation allocation{};
+	allocation.memory = pBlock->memory;
+	allocation.offset = offset;
+	allocation.size = MinAllocationSize << order;
+	allocation.pMappedData = (pBlock->pMappedData != nullptr) ? pBlock->pMappedData + offset : nullptr;
+	allocation.pool = poolIndex;
+	allocation.order = order;
+	m_AllocationCount++;
+	m_UsedBytes += allocation.size;
+	return allocation;
+}
+
+Allocation MemoryAllocator::AllocateDedicated(uint32_t memoryType, VkDeviceSize size, VkBuffer buffer, VkImage image)
+{
+	VkMemoryDedicatedAllocateInfo dedicatedInfo{};
+	dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+	dedicatedInfo.buffer = buffer;
+	dedicatedInfo.image = image;
+
+	VkMemoryAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.pNext = &dedicatedInfo;
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = memoryType;
+
+	Allocation allocation{};
+	ErrorCheck(vkAllocateMemory(m_pDevice->GetDevice(), &allocInfo, nullptr, &allocation.memory));
+	allocation.size = size;
+	allocation.pMappedData = Map(allocation.memory, memoryType);
+	m_DedicatedAllocationCount++;
+	m_DedicatedBytes += size;
+	m_AllocationCount++;
+	m_UsedBytes += size;
+	return allocation;
+}
+
+bool MemoryAllocator::AllocateFromBlock(Block& block, uint32_t order, VkDeviceSize& offset)
+{
+	uint32_t freeOrder = order;
+	while (freeOrder <= m_MaxOrder && block.freeLists[freeOrder].empty())
+	{
+		freeOrder++;
+	}
+	if (freeOrder > m_MaxOrder)
+		return false;
+
+	offset = *block.freeLists[freeOrder].begin();
+	block.freeLists[freeOrder].erase(block.freeLists[freeOrder].begin());
+	// Split until the range has the requested order, the upper halves stay free
+	while (freeOrder > order)
+	{
+		freeOrder--;
+		block.freeLists[freeOrder].insert(offset + (MinAllocationSize << freeOrder));
+	}
+	return true;
+}
+
+void MemoryAllocator::FreeToBlock(Block& block, VkDeviceSize offset, uint32_t order)
+{
+	// Merge with the buddy for as long as it is free as well
+	while (order < m_MaxOrder)
+	{
+		const VkDeviceSize buddy = offset ^ (MinAllocationSize << order);
+		auto it = block.freeLists[order].find(buddy);
+		if (it == block.freeLists[order].end())
+			break;
+
+		block.freeLists[order].erase(it);
+		offset = (offset < buddy) ? offset : buddy;
+		order++;
+	}
+	block.freeLists[order].insert(offset);
+}
+
+MemoryAllocator::Block MemoryAllocator::CreateBlock(uint32_t memoryType)
+{
+	VkMemoryAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = BlockSize;
+	allocInfo.memoryTypeIndex = memoryType;
+
+	Block block{};
+	ErrorCheck(vkAllocateMemory(m_pDevice->GetDevice(), &allocInfo, nullptr, &block.memory));
+	block.pMappedData = static_cast<char*>(Map(block.memory, memoryType));
+	block.freeLists.resize(m_MaxOrder + 1);
+	block.freeLists[m_MaxOrder].insert(0);
+	return block;
+}
+
+void MemoryAllocator::DestroyBlock(Block& block)
+{
+	vkFreeMemory(m_pDevice->GetDevice(), block.memory, nullptr);
+	block.memory = VK_NULL_HANDLE;
+}
+
+bool MemoryAllocator::IsEmpty(const Block& block) const
+{
+	return !block.freeLists[m_MaxOrder].empty();
+}
+
+void* MemoryAllocator::Map(VkDeviceMemory memory, uint32_t memoryType)
+{
+	// A VkDeviceMemory can only be mapped once, so host visible memory is mapped for its whole lifetime
+	if ((m_pDevice->GetPhysicalDeviceMemoryProperties().memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) == 0)
+		return nullptr;
+
+	void* pMappedData{};
+	ErrorCheck(vkMapMemory(m_pDevice->GetDevice(), memory, 0, VK_WHOLE_SIZE, 0, &pMappedData));
+	return pMappedData;
+}
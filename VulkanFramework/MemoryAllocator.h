@@ -0,0 +1,88 @@
+#pragma once
+#include "Platform.h"
+#include <set>
+#include <vector>
+
+namespace vkw
+{
+	class VulkanDevice;
+
+	// Memory of a buffer or image, either a range of a shared block or a dedicated VkDeviceMemory
+	struct Allocation
+	{
+		VkDeviceMemory	memory = VK_NULL_HANDLE;
+		VkDeviceSize	offset{};
+		VkDeviceSize	size{};
+		// Host visible memory stays mapped, null otherwise
+		void*			pMappedData = nullptr;
+		// Pool and buddy order of sub-allocations, the pool is UINT32_MAX for dedicated allocations
+		uint32_t		pool{ UINT32_MAX };
+		uint32_t		order{};
+	};
+
+	struct MemoryStats
+	{
+		uint32_t		blockCount{};
+		uint32_t		dedicatedAllocationCount{};
+		uint32_t		allocationCount{};
+		// Allocated from the driver
+		VkDeviceSize	reservedBytes{};
+		// Handed out to resources, sub-allocations are rounded up to a power of two
+		VkDeviceSize	usedBytes{};
+	};
+
+	// Sub-allocates buffers and images from large blocks per memory type with a buddy allocator, so the driver sees a
+	// handful of vkAllocateMemory calls instead of one per resource. Large resources and those the driver prefers
+	// to own their memory get a dedicated allocation.
+	class MemoryAllocator
+	{
+	public:
+		MemoryAllocator(VulkanDevice* pDevice);
+		~MemoryAllocator();
+
+		// Allocates the memory and binds the resource to it
+		Allocation AllocateBufferMemory(VkBuffer buffer, VkMemoryPropertyFlags properties);
+		Allocation AllocateImageMemory(VkImage image, VkMemoryPropertyFlags properties, bool linearTiling = false);
+		void Free(Allocation& allocation);
+		MemoryStats GetStats() const;
+
+		static const VkDeviceSize	BlockSize{ 64 * 1024 * 1024 };
+		static const VkDeviceSize	MinAllocationSize{ 256 };
+		static const VkDeviceSize	DedicatedThreshold{ BlockSize / 2 };
+
+	private:
+		struct Block
+		{
+			VkDeviceMemory						memory;
+			char*								pMappedData;
+			// Free offsets per order, order n covers MinAllocationSize << n bytes
+			std::vector<std::set<VkDeviceSize>>	freeLists;
+		};
+
+		struct Pool
+		{
+			uint32_t			memoryType;
+			std::vector<Block>	blocks;
+		};
+
+		Allocation Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool linear, bool dedicated, VkBuffer buffer, VkImage image);
+		Allocation AllocateDedicated(uint32_t memoryType, VkDeviceSize size, VkBuffer buffer, VkImage image);
+		bool AllocateFromBlock(Block& block, uint32_t order, VkDeviceSize& offset);
+		void FreeToBlock(Block& block, VkDeviceSize offset, uint32_t order);
+		Block CreateBlock(uint32_t memoryType);
+		void DestroyBlock(Block& block);
+		bool IsEmpty(const Block& block) const;
+		void* Map(VkDeviceMemory memory, uint32_t memoryType);
+
+		VulkanDevice*				m_pDevice = nullptr;
+		uint32_t					m_MaxOrder{};
+		// Linear and optimal resources only share pools when no granularity page can hold both
+		bool						m_SeparateOptimalImages{};
+		// Indexed by memory type, the optimal image pools follow the linear ones
+		std::vector<Pool>			m_Pools{};
+		uint32_t					m_DedicatedAllocationCount{};
+		VkDeviceSize				m_DedicatedBytes{};
+		uint32_t					m_AllocationCount{};
+		VkDeviceSize				m_UsedBytes{};
+	};
+}
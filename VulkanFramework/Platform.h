@@ -3,6 +3,7 @@
 #ifdef _WIN32
 
 #define VK_USE_PLATFORM_WIN32_KHR 1 //enables windows specific vulkan functions
+#define NOMINMAX //keeps Windows.h from defining min and max macros that break std::min and std::max
 #include <Windows.h>
 
 #else
@@ -0,0 +1,139 @@
+#include "QueueTimeline.h"
+#include "VulkanDevice.h"
+#include "VulkanHelpers.h"
+
+using namespace vkw;
+
+QueueTimeline::QueueTimeline(VulkanDevice* pDevice, VkQueue queue)
+	:m_pDevice(pDevice), m_Queue(queue)
+{
+	Init();
+}
+
+QueueTimeline::~QueueTimeline()
+{
+	Cleanup();
+}
+
+uint64_t QueueTimeline::Submit(VkCommandBuffer commandBuffer, const std::vector<SemaphoreWait>& waits, const std::vector<VkSemaphore>& binarySignals)
+{
+	std::vector<VkSemaphore> waitSemaphores(waits.size());
+	std::vector<uint64_t> waitValues(waits.size());
+	std::vector<VkPipelineStageFlags> waitStages(waits.size());
+	for (size_t i = 0; i < waits.size(); i++)
+	{
+		waitSemaphores[i] = waits[i].semaphore;
+		waitValues[i] = waits[i].value;
+		waitStages[i] = waits[i].stage;
+	}
+
+	// The timeline comes first, the values of the binary semaphores after it are ignored
+	std::vector<VkSemaphore> signalSemaphores{ m_Semaphore };
+	signalSemaphores.insert(signalSemaphores.end(), binarySignals.begin(), binarySignals.end());
+	std::vector<uint64_t> signalValues(signalSemaphores.size(), 0);
+	signalValues[0] = m_SubmittedValue + 1;
+
+	VkTimelineSemaphoreSubmitInfo timelineSubmitInfo{};
+	timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineSubmitInfo.waitSemaphoreValueCount = waitValues.size();
+	timelineSubmitInfo.pWaitSemaphoreValues = waitValues.data();
+	timelineSubmitInfo.signalSemaphoreValueCount = signalValues.size();
+	timelineSubmitInfo.pSignalSemaphoreValues = signalValues.data();
+
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = &timelineSubmitInfo;
+	submitInfo.waitSemaphoreCount = waitSemaphores.size();
+	submitInfo.pWaitSemaphores = waitSemaphores.data();
+	submitInfo.pWaitDstStageMask = waitStages.data();
+	submitInfo.signalSemaphoreCount = signalSemaphores.size();
+	submitInfo.pSignalSemaphores = signalSemaphores.data();
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+
+	ErrorCheck(vkQueueSubmit(m_Queue, 1, &submitInfo, VK_NULL_HANDLE));
+	return ++m_SubmittedValue;
+}
+
+QueueTimeline::SemaphoreWait QueueTimeline::WaitFor(uint64_t value, VkPipelineStageFlags stage) const
+{
+	return SemaphoreWait{ m_Semaphore, value, stage };
+}
+
+void QueueTimeline::Wait(uint64_t value) const
+{
+	VkSemaphoreWaitInfo waitInfo{};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &m_Semaphore;
+	waitInfo.pValues = &value;
+
+	ErrorCheck(vkWaitSemaphores(m_pDevice->GetDevice(), &waitInfo, UINT64_MAX));
+}
+
+bool QueueTimeline::IsComplete(uint64_t value) const
+{
+	return GetCompletedValue() >= value;
+}
+
+uint64_t QueueTimeline::GetCompletedValue() const
+{
+	uint64_t value{};
+	ErrorCheck(vkGetSemaphoreCounterValue(m_pDevice->GetDevice(), m_Semaphore, &value));
+	return value;
+}
+
+uint64_t QueueTimeline::GetSubmittedValue() const
+{
+	return m_SubmittedValue;
+}
+
+void QueueTimeline::DeferDestruction(std::function<void()> destroy)
+{
+	m_DeferredDestructions.push_back(DeferredDestruction{ m_SubmittedValue, destroy });
+}
+
+void QueueTimeline::CollectGarbage()
+{
+	if (m_DeferredDestructions.empty())
+		return;
+
+	// Deferred in submit order, so the completed ones are at the front
+	const uint64_t completedValue = GetCompletedValue();
+	while (!m_DeferredDestructions.empty() && m_DeferredDestructions.front().value <= completedValue)
+	{
+		m_DeferredDestructions.front().destroy();
+		m_DeferredDestructions.pop_front();
+	}
+}
+
+VkQueue QueueTimeline::GetQueue() const
+{
+	return m_Queue;
+}
+
+void QueueTimeline::Init()
+{
+	VkSemaphoreTypeCreateInfo semaphoreTypeCreateInfo{};
+	semaphoreTypeCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	semaphoreTypeCreateInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	semaphoreTypeCreateInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphoreCreateInfo{};
+	semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreCreateInfo.pNext = &semaphoreTypeCreateInfo;
+
+	ErrorCheck(vkCreateSemaphore(m_pDevice->GetDevice(), &semaphoreCreateInfo, nullptr, &m_Semaphore));
+}
+
+void QueueTimeline::Cleanup()
+{
+	// Everything submitted has to be finished before the semaphore it signals can go
+	Wait(m_SubmittedValue);
+	for (DeferredDestruction& deferred : m_DeferredDestructions)
+	{
+		deferred.destroy();
+	}
+	m_DeferredDestructions.clear();
+	vkDestroySemaphore(m_pDevice->GetDevice(), m_Semaphore, nullptr);
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "Platform.h"
+#include <deque>
+#include <functional>
+#include <vector>
+
+namespace vkw
+{
+	class VulkanDevice;
+	// A timeline semaphore per queue, every submit signals the next value. Other queues wait on those values on the gpu,
+	// the host waits on them before it reuses a resource and objects the gpu may still use are destroyed once their value completed.
+	class QueueTimeline
+	{
+	public:
+		// A semaphore a submit waits on, the value is ignored for binary semaphores
+		struct SemaphoreWait
+		{
+			VkSemaphore				semaphore;
+			uint64_t				value;
+			VkPipelineStageFlags	stage;
+		};
+
+		QueueTimeline(VulkanDevice* pDevice, VkQueue queue);
+		~QueueTimeline();
+
+		// Returns the value the submit signals once the command buffer finished, the binary semaphores are signaled with it
+		uint64_t Submit(VkCommandBuffer commandBuffer, const std::vector<SemaphoreWait>& waits = {}, const std::vector<VkSemaphore>& binarySignals = {});
+		// Wait of another submit on a value of this queue
+		SemaphoreWait WaitFor(uint64_t value, VkPipelineStageFlags stage) const;
+		void Wait(uint64_t value) const;
+		bool IsComplete(uint64_t value) const;
+		uint64_t GetCompletedValue() const;
+		uint64_t GetSubmittedValue() const;
+		// Runs the destruction once every submit made so far completed
+		void DeferDestruction(std::function<void()> destroy);
+		// Runs the deferred destructions whose value completed
+		void CollectGarbage();
+		VkQueue GetQueue() const;
+
+	private:
+		void Init();
+		void Cleanup();
+
+		struct DeferredDestruction
+		{
+			uint64_t				value;
+			std::function<void()>	destroy;
+		};
+
+		VulkanDevice*						m_pDevice = nullptr;
+		VkQueue								m_Queue = VK_NULL_HANDLE;
+		VkSemaphore							m_Semaphore = VK_NULL_HANDLE;
+		uint64_t							m_SubmittedValue{ 0 };
+		std::deque<DeferredDestruction>		m_DeferredDestructions{};
+	};
+}
@@ -2,7 +2,7 @@
 #include "Platform.h"
 #include <vector>
 
-VkShaderModule CreateShaderModule(const std::vector<char>& code, VkDevice device)
+inline VkShaderModule CreateShaderModule(const std::vector<char>& code, VkDevice device)
 {
 	VkShaderModule shaderModule{};
 
@@ -1,4 +1,28 @@
-glslangvalidator -V texture.frag -o texture.frag.spv
-glslangvalidator -V texture.vert -o texture.vert.spv
-glslangvalidator -V raytracing.comp -o raytracing.comp.spv
-pause
\ No newline at end of file
+@echo off
+rem Without arguments glslangvalidator is taken from the path, the build passes the one of the Vulkan SDK and does not pause
+cd /d "%~dp0"
+set GLSLANG=glslangvalidator
+if not "%~1"=="" set GLSLANG="%~1"
+%GLSLANG% -V texture.frag -o texture.frag.spv || exit /b 1
+%GLSLANG% -V texture.vert -o texture.vert.spv || exit /b 1
+%GLSLANG% -V raytracing.comp -o raytracing.comp.spv || exit /b 1
+%GLSLANG% -V -DPERSISTENT_THREADS raytracing.comp -o raytracing_persistent.comp.spv || exit /b 1
+%GLSLANG% -V -DADAPTIVE_SAMPLING raytracing.comp -o raytracing_adaptive.comp.spv || exit /b 1
+%GLSLANG% -V adaptive_schedule.comp -o adaptive_schedule.comp.spv || exit /b 1
+%GLSLANG% -V denoise.comp -o denoise.comp.spv || exit /b 1
+%GLSLANG% -V -DPASS_REPROJECT reproject.comp -o reproject.comp.spv || exit /b 1
+%GLSLANG% -V -DPASS_RESOLVE reproject.comp -o reproject_resolve.comp.spv || exit /b 1
+%GLSLANG% -V -DPASS_BOUNDS lbvh.comp -o lbvh_bounds.comp.spv || exit /b 1
+%GLSLANG% -V -DPASS_MORTON lbvh.comp -o lbvh_morton.comp.spv || exit /b 1
+%GLSLANG% -V -DPASS_RADIX_COUNT lbvh.comp -o lbvh_radix_count.comp.spv || exit /b 1
+%GLSLANG% -V -DPASS_RADIX_SCAN lbvh.comp -o lbvh_radix_scan.comp.spv || exit /b 1
+%GLSLANG% -V -DPASS_RADIX_SCATTER lbvh.comp -o lbvh_radix_scatter.comp.spv || exit /b 1
+%GLSLANG% -V -DPASS_HIERARCHY lbvh.comp -o lbvh_hierarchy.comp.spv || exit /b 1
+%GLSLANG% -V -DPASS_REFIT lbvh.comp -o lbvh_refit.comp.spv || exit /b 1
+%GLSLANG% -V -DPASS_GENERATE wavefront.comp -o wavefront_generate.comp.spv || exit /b 1
+%GLSLANG% -V -DPASS_ARGS wavefront.comp -o wavefront_args.comp.spv || exit /b 1
+%GLSLANG% -V -DPASS_EXTEND wavefront.comp -o wavefront_extend.comp.spv || exit /b 1
+%GLSLANG% -V -DPASS_SHADE wavefront.comp -o wavefront_shade.comp.spv || exit /b 1
+%GLSLANG% -V -DPASS_CONNECT wavefront.comp -o wavefront_connect.comp.spv || exit /b 1
+%GLSLANG% -V -DPASS_RESOLVE wavefront.comp -o wavefront_resolve.comp.spv || exit /b 1
+if "%~1"=="" pause
\ No newline at end of file
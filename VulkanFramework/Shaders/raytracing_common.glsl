@@ -0,0 +1,847 @@
+// Scene bindings, structs and the closest and any hit traversals shared by the megakernel (raytracing.comp) and the wavefront passes (wavefront.comp).
+// Every file including it declares its own local size.
+
+// Running mean of the samples since the last camera or scene change, see accumulate
+layout (binding = 0, rgba32f) uniform image2D accumulationImage;
+
+// Specialization constants, filled by VulkanApp::CreateComputePipeline from the loaded scene.
+// Primitive types the scene does not contain are compiled out of the traversals.
+layout (constant_id = 0) const uint MAX_DEPTH = 8;
+layout (constant_id = 1) const float EPSILON = 0.0;
+layout (constant_id = 2) const float MAXLEN = 1000.0;
+layout (constant_id = 3) const bool HAS_SPHERES = true;
+layout (constant_id = 4) const bool HAS_PLANES = true;
+layout (constant_id = 5) const bool HAS_TRIANGLES = true;
+
+#define BVH_LEAF_BIT 0x80000000u
+#define BVH_STACK_SIZE 64
+#define WIDE_BVH_FIRST_MASK 0x0FFFFFFFu
+#define WIDE_BVH_COUNT_SHIFT 28
+#define TRACE_FLAG_WIDE_TRIANGLES 1u
+#define TRACE_FLAG_WIDE_SPHERES 2u
+#define TRACE_FLAG_PRECOMPUTED_TRIANGLES 4u
+
+
+
+
+layout (binding = 1) uniform UBO 
+{
+	vec3 lightDir;
+	float aspectRatio;
+	vec2 rayOffset;
+	uint accumulatedFrames;
+	float fov;
+	vec4 pos;
+	vec4 forward;
+	vec4 right;
+	vec4 up;
+	uint traceFlags;
+	uint rouletteDepth;
+	uint frameIndex;
+	float varianceThreshold;
+	uint minimumAdaptiveFrames;
+	uint maxTileSamples;
+	uint maxHistoryFrames;
+	uint pad;
+	// Camera of the accumulated history, reproject.comp maps it to the current one
+	vec4 previousPos;
+	vec4 previousForward;
+	vec4 previousRight;
+	vec4 previousUp;
+	uvec2 traceSize;
+} ubo;
+
+struct Sphere 
+{
+	vec3 pos;
+	float radius;
+	uint material;
+	int id;
+	uint pad1;
+	uint pad2;
+};
+
+struct Plane
+{
+	vec3 normal;
+	float distance;
+	uint material;
+	int id;
+	uint pad1;
+	uint pad2;
+};
+
+struct Material
+{
+	vec3 diffuse;
+	float reflectance;
+};
+
+// Alternative layout of binding 4 with the edges precomputed on the cpu, selected with TRACE_FLAG_PRECOMPUTED_TRIANGLES
+struct PrecomputedTriangle
+{
+	vec3 p1;
+	int id;
+	vec3 edge1;
+	float pad1;
+	vec3 edge2;
+	float pad2;
+};
+
+struct BVHNode
+{
+	vec3 min;
+	uint leftFirst;
+	vec3 max;
+	uint rightCount;
+};
+
+// 4 wide node, child bounds are 8 bit offsets from origin in power of two steps (see WideBVH.h)
+struct WideBVHNode
+{
+	vec3 origin;
+	uint meta;
+	uvec4 children;
+	uint quantizedMin[3];
+	uint quantizedMax[3];
+	uint pad[2];
+};
+
+struct Instance
+{
+	mat4 worldToObject;
+	uint rootNode;
+	uint meshId;
+	uint wideRootNode;
+	uint material;
+};
+
+struct HitInfo
+{
+	vec3 normal;
+	float t;
+	vec3 position;
+	int id;
+	uint material;
+};
+
+struct Ray
+{
+	vec3 origin;
+	vec3 dir;
+	vec3 color;
+};
+
+layout (std140, binding = 2) buffer Spheres
+{
+	Sphere spheres[ ];
+};
+
+layout (std140, binding = 3) buffer Planes
+{
+	Plane planes[ ];
+};
+
+// Vertex indices in xyz and the id in w
+layout (std430, binding = 4) buffer Triangles
+{
+	uvec4 triangles[ ];
+};
+
+layout (std430, binding = 4) buffer PrecomputedTriangles
+{
+	PrecomputedTriangle precomputedTriangles[ ];
+};
+
+layout (binding = 5) uniform samplerCube samplerCubeMap;
+
+layout (std140, binding = 6) buffer TriangleBVH
+{
+	BVHNode triangleNodes[ ];
+};
+
+layout (std140, binding = 7) buffer SphereBVH
+{
+	BVHNode sphereNodes[ ];
+};
+
+layout (std140, binding = 8) buffer InstanceBVH
+{
+	BVHNode instanceNodes[ ];
+};
+
+layout (std140, binding = 9) buffer Instances
+{
+	Instance instances[ ];
+};
+
+layout (std430, binding = 10) buffer WideTriangleBVH
+{
+	WideBVHNode wideTriangleNodes[ ];
+};
+
+layout (std430, binding = 11) buffer WideSphereBVH
+{
+	WideBVHNode wideSphereNodes[ ];
+};
+
+layout (std430, binding = 12) buffer Vertices
+{
+	vec4 vertices[ ];
+};
+
+layout (std430, binding = 13) buffer Materials
+{
+	Material materials[ ];
+};
+
+// Running mean of the squared luminance per pixel, the sample count of the pixel is kept in w of the accumulation image
+layout (std430, binding = 15) buffer Moments
+{
+	float luminanceMoments[ ];
+};
+
+// Filled by adaptive_schedule.comp: the indirect dispatch of the adaptive megakernel and per listed tile its index and sample budget
+layout (std430, binding = 16) buffer TileList
+{
+	uvec4 tileDispatch;
+	uvec2 tiles[ ];
+};
+
+// Primary hit of every pixel, the edge stopping features of the denoiser (denoise.comp). Misses have a negative id.
+struct Feature
+{
+	vec3 normal;
+	float depth;
+	int id;
+	uint material;
+	uint pad1;
+	uint pad2;
+};
+
+layout (std430, binding = 17) buffer Features
+{
+	Feature features[ ];
+};
+
+void reflectRay(inout vec3 rayD, in vec3 mormal)
+{
+	rayD = rayD + 2.0 * -dot(mormal, rayD) * mormal;
+}
+
+
+float sphereIntersect(in vec3 rayO, in vec3 rayD, in Sphere sphere)
+{
+	vec3 oc = rayO - sphere.pos;
+	float b = 2.0 * dot(oc, rayD);
+	float c = dot(oc, oc) - sphere.radius*sphere.radius;
+	float h = b*b - 4.0*c;
+	if (h < 0.0) 
+	{
+		return -1.0;
+	}
+	float t = (-b - sqrt(h)) / 2.0;
+
+	return t;
+}
+
+vec3 sphereNormal(in vec3 pos, in Sphere sphere)
+{
+	return (pos - sphere.pos) / sphere.radius;
+}
+
+
+float planeIntersect(vec3 rayO, vec3 rayD, Plane plane)
+{
+	float d = dot(rayD, plane.normal);
+
+	if (d == 0.0)
+		return 0.0;
+
+	float t = -(plane.distance + dot(rayO, plane.normal)) / d;
+
+	if (t < 0.0)
+		return 0.0;
+
+	return t;
+}
+
+float triangleIntersect(vec3 rayO, vec3 rayD, vec3 p1, vec3 edge1, vec3 edge2)
+{
+	//using Möller–Trumbore intersection algorithm
+	//https://en.wikipedia.org/wiki/Möller–Trumbore_intersection_algorithm
+    vec3 h, s, q;
+    float a,f,u,v;
+    h = cross(rayD, edge2);
+    a = dot(edge1, h);
+    if (a > -EPSILON && a < EPSILON)
+        return -1;    // This ray is parallel to this triangle.
+    f = 1.0/a;
+    s = rayO - p1;
+    u = f * dot(s, h);
+    if (u < 0.0 || u > 1.0)
+        return -1;
+    q = cross(s, edge1);
+    v = f * dot(rayD, q);
+    if (v < 0.0 || u + v > 1.0)
+        return -1;
+    // At this stage we can compute t to find out where the intersection point is on the line.
+    float t = f * dot(edge2, q);
+    if (t > EPSILON) // ray intersection
+    {
+        return t;
+    }
+    else // This means that there is a line intersection but not a ray intersection.
+        return -1;
+}
+
+bool aabbIntersect(vec3 rayO, vec3 invD, vec3 boxMin, vec3 boxMax, float maxT, out float tNear)
+{
+	vec3 t0 = (boxMin - rayO) * invD;
+	vec3 t1 = (boxMax - rayO) * invD;
+	vec3 tMin = min(t0, t1);
+	vec3 tMax = max(t0, t1);
+	tNear = max(max(tMin.x, tMin.y), tMin.z);
+	float tFar = min(min(tMax.x, tMax.y), tMax.z);
+	return tNear <= tFar && tFar > 0.0 && tNear < maxT;
+}
+
+bool aabbIntersect(vec3 rayO, vec3 invD, vec3 boxMin, vec3 boxMax, float maxT)
+{
+	float tNear;
+	return aabbIntersect(rayO, invD, boxMin, boxMax, maxT, tNear);
+}
+
+// Decodes and tests the children of a wide node, the hit children are returned sorted front to back
+uint intersectWideNode(in WideBVHNode node, vec3 rayO, vec3 invD, float maxT, out uint hitChildren[4])
+{
+	uint childCount = node.meta >> 24;
+	vec3 step = vec3(uintBitsToFloat((node.meta & 0xFFu) << 23), uintBitsToFloat(((node.meta >> 8) & 0xFFu) << 23), uintBitsToFloat(((node.meta >> 16) & 0xFFu) << 23));
+
+	float hitDistances[4];
+	uint hitCount = 0;
+	for (uint i = 0; i < childCount; i++)
+	{
+		uint shift = i * 8;
+		vec3 quantizedMin = vec3((node.quantizedMin[0] >> shift) & 0xFFu, (node.quantizedMin[1] >> shift) & 0xFFu, (node.quantizedMin[2] >> shift) & 0xFFu);
+		vec3 quantizedMax = vec3((node.quantizedMax[0] >> shift) & 0xFFu, (node.quantizedMax[1] >> shift) & 0xFFu, (node.quantizedMax[2] >> shift) & 0xFFu);
+		float tNear;
+		if (!aabbIntersect(rayO, invD, node.origin + quantizedMin * step, node.origin + quantizedMax * step, maxT, tNear))
+			continue;
+
+		// Insertion sort, there are at most 4 children
+		uint j = hitCount++;
+		for (; j > 0 && hitDistances[j - 1] > tNear; j--)
+		{
+			hitDistances[j] = hitDistances[j - 1];
+			hitChildren[j] = hitChildren[j - 1];
+		}
+		hitDistances[j] = tNear;
+		hitChildren[j] = node.children[i];
+	}
+	return hitCount;
+}
+
+void intersectSphereRange(in Ray ray, uint first, uint count, inout HitInfo hitInfo)
+{
+	for (uint i = first; i < first + count; i++)
+	{
+		float tSphere = sphereIntersect(ray.origin, ray.dir, spheres[i]);
+		if ((tSphere > EPSILON) && (tSphere < hitInfo.t))
+		{
+			hitInfo.id = spheres[i].id;
+			hitInfo.material = spheres[i].material;
+			hitInfo.position = ray.origin + tSphere * ray.dir;
+			hitInfo.normal = sphereNormal(hitInfo.position, spheres[i]);
+			hitInfo.t = tSphere;
+		}
+	}
+}
+
+void fetchTriangle(uint index, out vec3 p1, out vec3 edge1, out vec3 edge2, out int id)
+{
+	if ((ubo.traceFlags & TRACE_FLAG_PRECOMPUTED_TRIANGLES) != 0)
+	{
+		PrecomputedTriangle triangle = precomputedTriangles[index];
+		p1 = triangle.p1;
+		edge1 = triangle.edge1;
+		edge2 = triangle.edge2;
+		id = triangle.id;
+	}
+	else
+	{
+		uvec4 triangle = triangles[index];
+		p1 = vertices[triangle.x].xyz;
+		edge1 = vertices[triangle.y].xyz - p1;
+		edge2 = vertices[triangle.z].xyz - p1;
+		id = int(triangle.w);
+	}
+}
+
+bool intersectTriangleRange(in Ray ray, uint first, uint count, inout HitInfo hitInfo)
+{
+	bool hit = false;
+	for (uint i = first; i < first + count; i++)
+	{
+		vec3 p1, edge1, edge2;
+		int id;
+		fetchTriangle(i, p1, edge1, edge2, id);
+		float tTriangle = triangleIntersect(ray.origin, ray.dir, p1, edge1, edge2);
+		if ((tTriangle > EPSILON) && (tTriangle < hitInfo.t))
+		{
+			// The normal is only needed for the closest hit, so it is not stored
+			vec3 normal = normalize(cross(edge1, edge2));
+			hitInfo.id = id;
+			hitInfo.normal = faceforward(normal, ray.dir, normal);
+			hitInfo.t = tTriangle;
+			hit = true;
+		}
+	}
+	return hit;
+}
+
+void intersectSpheresWide(in Ray ray, inout HitInfo hitInfo)
+{
+	vec3 invDir = 1.0 / ray.dir;
+	uint stack[BVH_STACK_SIZE];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0)
+	{
+		uint hitChildren[4];
+		uint hitCount = intersectWideNode(wideSphereNodes[stack[--stackSize]], ray.origin, invDir, hitInfo.t, hitChildren);
+		for (uint i = 0; i < hitCount; i++)
+		{
+			if ((hitChildren[i] & BVH_LEAF_BIT) != 0)
+				intersectSphereRange(ray, hitChildren[i] & WIDE_BVH_FIRST_MASK, ((hitChildren[i] >> WIDE_BVH_COUNT_SHIFT) & 7u) + 1, hitInfo);
+		}
+		// Farthest first so the nearest child is popped next
+		for (int i = int(hitCount) - 1; i >= 0; i--)
+		{
+			if ((hitChildren[i] & BVH_LEAF_BIT) == 0 && stackSize < BVH_STACK_SIZE)
+				stack[stackSize++] = hitChildren[i];
+		}
+	}
+}
+
+void intersectSpheres(in Ray ray, inout HitInfo hitInfo)
+{
+	if (sphereNodes.length() == 0)
+		return;
+
+	if ((ubo.traceFlags & TRACE_FLAG_WIDE_SPHERES) != 0)
+	{
+		intersectSpheresWide(ray, hitInfo);
+		return;
+	}
+
+	vec3 invDir = 1.0 / ray.dir;
+	uint stack[BVH_STACK_SIZE];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0)
+	{
+		BVHNode node = sphereNodes[stack[--stackSize]];
+		if (!aabbIntersect(ray.origin, invDir, node.min, node.max, hitInfo.t))
+			continue;
+
+		if ((node.rightCount & BVH_LEAF_BIT) != 0)
+		{
+			intersectSphereRange(ray, node.leftFirst, node.rightCount & ~BVH_LEAF_BIT, hitInfo);
+		}
+		else if (stackSize + 2 <= BVH_STACK_SIZE)
+		{
+			stack[stackSize++] = node.rightCount;
+			stack[stackSize++] = node.leftFirst;
+		}
+	}
+}
+
+bool intersectTrianglesWide(in Ray ray, uint rootNode, inout HitInfo hitInfo)
+{
+	bool hit = false;
+	vec3 invDir = 1.0 / ray.dir;
+	uint stack[BVH_STACK_SIZE];
+	int stackSize = 0;
+	stack[stackSize++] = rootNode;
+	while (stackSize > 0)
+	{
+		uint hitChildren[4];
+		uint hitCount = intersectWideNode(wideTriangleNodes[stack[--stackSize]], ray.origin, invDir, hitInfo.t, hitChildren);
+		for (uint i = 0; i < hitCount; i++)
+		{
+			if ((hitChildren[i] & BVH_LEAF_BIT) != 0)
+				hit = intersectTriangleRange(ray, hitChildren[i] & WIDE_BVH_FIRST_MASK, ((hitChildren[i] >> WIDE_BVH_COUNT_SHIFT) & 7u) + 1, hitInfo) || hit;
+		}
+		for (int i = int(hitCount) - 1; i >= 0; i--)
+		{
+			if ((hitChildren[i] & BVH_LEAF_BIT) == 0 && stackSize < BVH_STACK_SIZE)
+				stack[stackSize++] = hitChildren[i];
+		}
+	}
+	return hit;
+}
+
+// Traverses the bottom level bvh of a mesh with a ray in object space, only t, id and the object space normal are written
+bool intersectTriangles(in Ray ray, uint rootNode, inout HitInfo hitInfo)
+{
+	bool hit = false;
+	vec3 invDir = 1.0 / ray.dir;
+	uint stack[BVH_STACK_SIZE];
+	int stackSize = 0;
+	stack[stackSize++] = rootNode;
+	while (stackSize > 0)
+	{
+		BVHNode node = triangleNodes[stack[--stackSize]];
+		if (!aabbIntersect(ray.origin, invDir, node.min, node.max, hitInfo.t))
+			continue;
+
+		if ((node.rightCount & BVH_LEAF_BIT) != 0)
+		{
+			hit = intersectTriangleRange(ray, node.leftFirst, node.rightCount & ~BVH_LEAF_BIT, hitInfo) || hit;
+		}
+		else if (stackSize + 2 <= BVH_STACK_SIZE)
+		{
+			stack[stackSize++] = node.rightCount;
+			stack[stackSize++] = node.leftFirst;
+		}
+	}
+	return hit;
+}
+
+void intersectInstances(in Ray ray, inout HitInfo hitInfo)
+{
+	vec3 invDir = 1.0 / ray.dir;
+	uint stack[BVH_STACK_SIZE];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0)
+	{
+		BVHNode node = instanceNodes[stack[--stackSize]];
+		if (!aabbIntersect(ray.origin, invDir, node.min, node.max, hitInfo.t))
+			continue;
+
+		if ((node.rightCount & BVH_LEAF_BIT) != 0)
+		{
+			uint last = node.leftFirst + (node.rightCount & ~BVH_LEAF_BIT);
+			for (uint i = node.leftFirst; i < last; i++)
+			{
+				// The object space direction is not normalized so t stays the same in both spaces
+				Ray objectRay = ray;
+				objectRay.origin = (instances[i].worldToObject * vec4(ray.origin, 1.0)).xyz;
+				objectRay.dir = mat3(instances[i].worldToObject) * ray.dir;
+				bool hit = ((ubo.traceFlags & TRACE_FLAG_WIDE_TRIANGLES) != 0) ? intersectTrianglesWide(objectRay, instances[i].wideRootNode, hitInfo) : intersectTriangles(objectRay, instances[i].rootNode, hitInfo);
+				if (hit)
+				{
+					hitInfo.material = instances[i].material;
+					hitInfo.position = ray.origin + hitInfo.t * ray.dir;
+					hitInfo.normal = normalize(transpose(mat3(instances[i].worldToObject)) * hitInfo.normal);
+				}
+			}
+		}
+		else if (stackSize + 2 <= BVH_STACK_SIZE)
+		{
+			stack[stackSize++] = node.rightCount;
+			stack[stackSize++] = node.leftFirst;
+		}
+	}
+}
+	
+HitInfo intersect(in Ray ray, in float maxT)
+{
+	HitInfo hitInfo;
+	hitInfo.t = maxT;
+	hitInfo.id = -1;
+	hitInfo.material = 0;
+
+	if (HAS_SPHERES)
+	{
+		intersectSpheres(ray, hitInfo);
+	}
+
+	for (int i = 0; HAS_PLANES && i < planes.length(); i++)
+	{
+		float tplane = planeIntersect(ray.origin, ray.dir, planes[i]);
+		if ((tplane > EPSILON) && (tplane < hitInfo.t))
+		{
+			hitInfo.id = planes[i].id;
+			hitInfo.material = planes[i].material;
+			hitInfo.position = ray.origin + tplane * ray.dir;
+			hitInfo.normal = planes[i].normal;
+			hitInfo.t = tplane;
+		}	
+	}
+
+	if (HAS_TRIANGLES)
+	{
+		intersectInstances(ray, hitInfo);
+	}
+	
+	return hitInfo;
+}
+
+// Any hit queries for shadow rays, traversal stops at the first primitive closer than maxT and no hit attributes are computed
+
+bool occludedSphereRange(in Ray ray, uint first, uint count, float maxT)
+{
+	for (uint i = first; i < first + count; i++)
+	{
+		float tSphere = sphereIntersect(ray.origin, ray.dir, spheres[i]);
+		if ((tSphere > EPSILON) && (tSphere < maxT))
+			return true;
+	}
+	return false;
+}
+
+bool occludedSpheres(in Ray ray, float maxT)
+{
+	if (sphereNodes.length() == 0)
+		return false;
+
+	vec3 invDir = 1.0 / ray.dir;
+	uint stack[BVH_STACK_SIZE];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+	if ((ubo.traceFlags & TRACE_FLAG_WIDE_SPHERES) != 0)
+	{
+		while (stackSize > 0)
+		{
+			uint hitChildren[4];
+			uint hitCount = intersectWideNode(wideSphereNodes[stack[--stackSize]], ray.origin, invDir, maxT, hitChildren);
+			for (int i = int(hitCount) - 1; i >= 0; i--)
+			{
+				if ((hitChildren[i] & BVH_LEAF_BIT) == 0)
+				{
+					if (stackSize < BVH_STACK_SIZE)
+						stack[stackSize++] = hitChildren[i];
+				}
+				else if (occludedSphereRange(ray, hitChildren[i] & WIDE_BVH_FIRST_MASK, ((hitChildren[i] >> WIDE_BVH_COUNT_SHIFT) & 7u) + 1, maxT))
+					return true;
+			}
+		}
+		return false;
+	}
+
+	while (stackSize > 0)
+	{
+		BVHNode node = sphereNodes[stack[--stackSize]];
+		if (!aabbIntersect(ray.origin, invDir, node.min, node.max, maxT))
+			continue;
+
+		if ((node.rightCount & BVH_LEAF_BIT) != 0)
+		{
+			if (occludedSphereRange(ray, node.leftFirst, node.rightCount & ~BVH_LEAF_BIT, maxT))
+				return true;
+		}
+		else if (stackSize + 2 <= BVH_STACK_SIZE)
+		{
+			stack[stackSize++] = node.rightCount;
+			stack[stackSize++] = node.leftFirst;
+		}
+	}
+	return false;
+}
+
+bool occludedTriangleRange(in Ray ray, uint first, uint count, float maxT)
+{
+	for (uint i = first; i < first + count; i++)
+	{
+		vec3 p1, edge1, edge2;
+		int id;
+		fetchTriangle(i, p1, edge1, edge2, id);
+		float tTriangle = triangleIntersect(ray.origin, ray.dir, p1, edge1, edge2);
+		if ((tTriangle > EPSILON) && (tTriangle < maxT))
+			return true;
+	}
+	return false;
+}
+
+bool occludedTriangles(in Ray ray, uint rootNode, uint wideRootNode, float maxT)
+{
+	vec3 invDir = 1.0 / ray.dir;
+	uint stack[BVH_STACK_SIZE];
+	int stackSize = 0;
+	if ((ubo.traceFlags & TRACE_FLAG_WIDE_TRIANGLES) != 0)
+	{
+		stack[stackSize++] = wideRootNode;
+		while (stackSize > 0)
+		{
+			uint hitChildren[4];
+			uint hitCount = intersectWideNode(wideTriangleNodes[stack[--stackSize]], ray.origin, invDir, maxT, hitChildren);
+			for (int i = int(hitCount) - 1; i >= 0; i--)
+			{
+				if ((hitChildren[i] & BVH_LEAF_BIT) == 0)
+				{
+					if (stackSize < BVH_STACK_SIZE)
+						stack[stackSize++] = hitChildren[i];
+				}
+				else if (occludedTriangleRange(ray, hitChildren[i] & WIDE_BVH_FIRST_MASK, ((hitChildren[i] >> WIDE_BVH_COUNT_SHIFT) & 7u) + 1, maxT))
+					return true;
+			}
+		}
+		return false;
+	}
+
+	stack[stackSize++] = rootNode;
+	while (stackSize > 0)
+	{
+		BVHNode node = triangleNodes[stack[--stackSize]];
+		if (!aabbIntersect(ray.origin, invDir, node.min, node.max, maxT))
+			continue;
+
+		if ((node.rightCount & BVH_LEAF_BIT) != 0)
+		{
+			if (occludedTriangleRange(ray, node.leftFirst, node.rightCount & ~BVH_LEAF_BIT, maxT))
+				return true;
+		}
+		else if (stackSize + 2 <= BVH_STACK_SIZE)
+		{
+			stack[stackSize++] = node.rightCount;
+			stack[stackSize++] = node.leftFirst;
+		}
+	}
+	return false;
+}
+
+bool occludedInstances(in Ray ray, float maxT)
+{
+	vec3 invDir = 1.0 / ray.dir;
+	uint stack[BVH_STACK_SIZE];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0)
+	{
+		BVHNode node = instanceNodes[stack[--stackSize]];
+		if (!aabbIntersect(ray.origin, invDir, node.min, node.max, maxT))
+			continue;
+
+		if ((node.rightCount & BVH_LEAF_BIT) != 0)
+		{
+			uint last = node.leftFirst + (node.rightCount & ~BVH_LEAF_BIT);
+			for (uint i = node.leftFirst; i < last; i++)
+			{
+				Ray objectRay = ray;
+				objectRay.origin = (instances[i].worldToObject * vec4(ray.origin, 1.0)).xyz;
+				objectRay.dir = mat3(instances[i].worldToObject) * ray.dir;
+				if (occludedTriangles(objectRay, instances[i].rootNode, instances[i].wideRootNode, maxT))
+					return true;
+			}
+		}
+		else if (stackSize + 2 <= BVH_STACK_SIZE)
+		{
+			stack[stackSize++] = node.rightCount;
+			stack[stackSize++] = node.leftFirst;
+		}
+	}
+	return false;
+}
+
+bool occluded(in Ray ray, in float maxT)
+{
+	for (int i = 0; HAS_PLANES && i < planes.length(); i++)
+	{
+		float tplane = planeIntersect(ray.origin, ray.dir, planes[i]);
+		if ((tplane > EPSILON) && (tplane < maxT))
+			return true;
+	}
+
+	return (HAS_SPHERES && occludedSpheres(ray, maxT)) || (HAS_TRIANGLES && occludedInstances(ray, maxT));
+}
+
+vec3 skyColor(vec3 dir)
+{
+	vec3 color = vec3(0.4f, 0.5f, 0.9f);
+	return mix(color, vec3(1.f, 1.f, 1.f), 1-dir.y);
+}
+
+// PCG hash (Jarzynski and Olano 2020), used both to seed and to advance the per path random state
+uint pcgHash(uint value)
+{
+	uint state = value * 747796405u + 2891336453u;
+	uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+uint pathSeed(uint pixel)
+{
+	return pcgHash(pixel ^ pcgHash(ubo.frameIndex));
+}
+
+float randomFloat(inout uint seed)
+{
+	seed = pcgHash(seed);
+	return float(seed >> 8) / 16777216.0;
+}
+
+// Decides whether the path continues after the given bounce. Past ubo.rouletteDepth paths survive with a probability equal to their throughput,
+// survivors are reweighted so the estimate stays unbiased.
+bool continuePath(inout vec3 throughput, uint bounce, inout uint seed)
+{
+	if (bounce + 1 >= MAX_DEPTH)
+		return false;
+	if (bounce + 1 < ubo.rouletteDepth)
+		return true;
+
+	float survival = min(max(throughput.r, max(throughput.g, throughput.b)), 1.0);
+	if (randomFloat(seed) >= survival)
+		return false;
+	throughput /= survival;
+	return true;
+}
+
+// Size of the traced rectangle at the top left of the accumulation image, it changes with the resolution scale (VulkanApp::UpdateResolutionScale).
+// The per pixel buffers keep the stride of the whole image.
+ivec2 traceSize()
+{
+	return ivec2(ubo.traceSize);
+}
+
+Ray cameraRay(uvec2 pixel, ivec2 dim, vec2 offset)
+{
+	vec2 uv = vec2(pixel+offset) / dim.xy;
+	uv = -1.0 + 2.0 * uv;
+	Ray ray;
+	ray.origin = ubo.pos.xyz;
+	ray.dir = normalize(uv.x*ubo.right.xyz*ubo.aspectRatio + uv.y*ubo.up.xyz + 1*ubo.forward.xyz);
+	ray.color = vec3(1.f, 1.f, 1.f);
+	return ray;
+}
+
+Ray cameraRay(uvec2 pixel, ivec2 dim)
+{
+	return cameraRay(pixel, dim, ubo.rayOffset);
+}
+
+void storeFeatures(uint index, HitInfo hit)
+{
+	bool isHit = hit.t < MAXLEN;
+	features[index] = Feature(isHit ? hit.normal : vec3(0.0), hit.t, isHit ? hit.id : -1, hit.material, 0u, 0u);
+}
+
+float luminance(vec3 color)
+{
+	return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+// Adds sampleCount samples of the pixel, given as the sum of their colors and of their squared luminances, to the running means
+void accumulate(ivec2 pixel, vec3 colorSum, float momentSum, uint sampleCount)
+{
+	uint index = uint(pixel.y * imageSize(accumulationImage).x + pixel.x);
+	vec4 previous = vec4(0.0);
+	float previousMoment = 0.0;
+	if (ubo.accumulatedFrames > 0)
+	{
+		previous = imageLoad(accumulationImage, pixel);
+		previousMoment = luminanceMoments[index];
+	}
+
+	float count = previous.w + float(sampleCount);
+	imageStore(accumulationImage, pixel, vec4(previous.xyz + (colorSum - float(sampleCount) * previous.xyz) / count, count));
+	luminanceMoments[index] = previousMoment + (momentSum - float(sampleCount) * previousMoment) / count;
+}
+
+void accumulate(ivec2 pixel, vec3 color)
+{
+	float pixelLuminance = luminance(color);
+	accumulate(pixel, color, pixelLuminance * pixelLuminance, 1u);
+}
@@ -1,19 +1,31 @@
 #version 450
 
-layout (binding = 0) uniform sampler2DArray oldSamples;
+// Running mean written by the raytracing passes, fetched as float formats are not guaranteed to be filterable
+layout (binding = 0) uniform sampler2D accumulation;
+
+// Traced rectangle at the top left of the image, upscaled to the swapchain
+layout (push_constant) uniform PushConstants
+{
+	uvec2 traceSize;
+} pc;
 
 layout (location = 0) in vec2 inUV;
 
 layout (location = 0) out vec4 outFragColor;
 
+vec3 fetch(ivec2 texel)
+{
+	return texelFetch(accumulation, clamp(texel, ivec2(0), ivec2(pc.traceSize) - 1), 0).xyz;
+}
+
 void main() 
 {
-	ivec3 dim = textureSize(oldSamples, 0);
-	vec4 color = {0.f, 0.f, 0.f, 0.f};
-	for(int i = 0; i < dim.z; ++i)
-	{
-		color += texture(oldSamples, vec3(inUV.s, 1.0 - inUV.t, i))/dim.z;
-	}
-	outFragColor = color;
+	// Bilinear by hand, at full size every fragment lands on a texel center
+	vec2 coordinate = vec2(inUV.s, 1.0 - inUV.t) * vec2(pc.traceSize) - 0.5;
+	ivec2 texel = ivec2(floor(coordinate));
+	vec2 fraction = coordinate - vec2(texel);
+	vec3 top = mix(fetch(texel), fetch(texel + ivec2(1, 0)), fraction.x);
+	vec3 bottom = mix(fetch(texel + ivec2(0, 1)), fetch(texel + ivec2(1, 1)), fraction.x);
+	outFragColor = vec4(mix(top, bottom, fraction.y), 1.0);
   //outFragColor = texture(samplerColor, vec2(inUV.s, 1.0 - inUV.t)) + texture(oldSamples, vec2(inUV.s, 1.0 - inUV.t));
 }
\ No newline at end of file
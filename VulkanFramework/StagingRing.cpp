@@ -0,0 +1,173 @@
+#include "StagingRing.h"
+#include "VulkanDevice.h"
+#include "VulkanHelpers.h"
+#include "QueueTimeline.h"
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+using namespace vkw;
+
+StagingRing::StagingRing(VulkanDevice* pDevice, QueueTimeline* pTimeline, uint32_t queueFamilyId, VkDeviceSize capacity)
+	:m_pDevice(pDevice), m_pTimeline(pTimeline), m_QueueFamilyId(queueFamilyId), m_Capacity(capacity)
+{
+	Init();
+}
+
+StagingRing::~StagingRing()
+{
+	Cleanup();
+}
+
+void StagingRing::Upload(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size)
+{
+	if (size == 0)
+		return;
+
+	const VkDeviceSize offset = Allocate(size);
+	memcpy(m_pMappedMemory + offset, data, size);
+
+	VkBufferCopy region{};
+	region.srcOffset = offset;
+	region.dstOffset = dstOffset;
+	region.size = size;
+	m_PendingCopies.push_back(PendingCopy{ dstBuffer, region });
+}
+
+uint64_t StagingRing::Flush()
+{
+	if (m_PendingCopies.empty())
+		return 0;
+
+	// Command buffers of completed copies are returned to the pool
+	while (!m_CommandBuffers.empty() && m_pTimeline->IsComplete(m_CommandBuffers.front().value))
+	{
+		vkFreeCommandBuffers(m_pDevice->GetDevice(), m_CommandPool, 1, &m_CommandBuffers.front().commandBuffer);
+		m_CommandBuffers.pop_front();
+	}
+
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandPool = m_CommandPool;
+	allocInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer{};
+	ErrorCheck(vkAllocateCommandBuffers(m_pDevice->GetDevice(), &allocInfo, &commandBuffer));
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	ErrorCheck(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+
+	// Earlier submits on the queue may still read the destinations
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	for (const PendingCopy& copy : m_PendingCopies)
+	{
+		vkCmdCopyBuffer(commandBuffer, m_Buffer, copy.dstBuffer, 1, &copy.region);
+	}
+
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+		0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	ErrorCheck(vkEndCommandBuffer(commandBuffer));
+
+	const uint64_t value = m_pTimeline->Submit(commandBuffer);
+	m_CommandBuffers.push_back(SubmittedCommandBuffer{ commandBuffer, value });
+	m_PendingCopies.clear();
+	// The unflushed regions are at the back
+	for (auto it = m_Regions.rbegin(); it != m_Regions.rend() && it->value == 0; ++it)
+	{
+		it->value = value;
+	}
+	return value;
+}
+
+void StagingRing::Init()
+{
+	CreateBuffer(
+		m_pDevice->GetDevice(), m_pDevice->GetAllocator(),
+		m_Capacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		m_Buffer, m_Allocation
+	);
+	m_pMappedMemory = static_cast<char*>(m_Allocation.pMappedData);
+
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = m_QueueFamilyId;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	ErrorCheck(vkCreateCommandPool(m_pDevice->GetDevice(), &poolInfo, nullptr, &m_CommandPool));
+}
+
+void StagingRing::Cleanup()
+{
+	// Copies that were never flushed are dropped
+	m_pTimeline->Wait(m_pTimeline->GetSubmittedValue());
+	vkDestroyCommandPool(m_pDevice->GetDevice(), m_CommandPool, nullptr);
+	vkDestroyBuffer(m_pDevice->GetDevice(), m_Buffer, nullptr);
+	m_pDevice->GetAllocator()->Free(m_Allocation);
+}
+
+VkDeviceSize StagingRing::Allocate(VkDeviceSize size)
+{
+	if (size > m_Capacity - RegionAlignment)
+	{
+		assert(false && "The upload does not fit in the staging ring!");
+		std::exit(-1);
+	}
+
+	ReleaseCompleted();
+	while (true)
+	{
+		if (m_Regions.empty())
+			m_Head = 0;
+
+		// The head stays strictly behind the oldest region, so a head past the tail means the used part does not wrap
+		VkDeviceSize begin = (m_Head + RegionAlignment - 1) / RegionAlignment * RegionAlignment;
+		const VkDeviceSize tail = m_Regions.empty() ? m_Capacity : m_Regions.front().begin;
+		bool fits{};
+		if (m_Regions.empty() || m_Head > tail)
+		{
+			fits = begin + size <= m_Capacity;
+			// Wrap around, the end of the ring stays unused
+			if (!fits && size < tail)
+			{
+				begin = 0;
+				fits = true;
+			}
+		}
+		else
+		{
+			fits = begin + size < tail;
+		}
+
+		if (fits)
+		{
+			m_Head = begin + size;
+			m_Regions.push_back(Region{ begin, m_Head, 0 });
+			return begin;
+		}
+
+		// Full, the host waits for the copies of the oldest region
+		if (m_Regions.front().value == 0)
+			Flush();
+		m_pTimeline->Wait(m_Regions.front().value);
+		ReleaseCompleted();
+	}
+}
+
+void StagingRing::ReleaseCompleted()
+{
+	const uint64_t completedValue = m_pTimeline->GetCompletedValue();
+	while (!m_Regions.empty() && m_Regions.front().value != 0 && m_Regions.front().value <= completedValue)
+	{
+		m_Regions.pop_front();
+	}
+}
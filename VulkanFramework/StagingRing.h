@@ -0,0 +1,68 @@
+#pragma once
+#include "Platform.h"
+#include "MemoryAllocator.h"
+#include <deque>
+#include <vector>
+
+namespace vkw
+{
+	class VulkanDevice;
+	class QueueTimeline;
+	// Persistently mapped staging buffer that device local buffers are updated through without blocking.
+	// Upload copies the data into the next free region of the ring and queues the copy, Flush records every queued copy
+	// in a command buffer and submits it on the timeline's queue. A region is reused once the timeline passed the submit
+	// that copied it, the host only waits when the ring is full.
+	class StagingRing
+	{
+	public:
+		StagingRing(VulkanDevice* pDevice, QueueTimeline* pTimeline, uint32_t queueFamilyId, VkDeviceSize capacity);
+		~StagingRing();
+
+		void Upload(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size);
+		// Submits the queued copies, commands submitted to the queue afterwards see the new data.
+		// Returns the timeline value of the copies, 0 when nothing was queued.
+		uint64_t Flush();
+
+		static const VkDeviceSize	RegionAlignment{ 16 };
+
+	private:
+		void Init();
+		void Cleanup();
+		VkDeviceSize Allocate(VkDeviceSize size);
+		void ReleaseCompleted();
+
+		// A region that was not flushed yet has a value of 0
+		struct Region
+		{
+			VkDeviceSize	begin;
+			VkDeviceSize	end;
+			uint64_t		value;
+		};
+
+		struct PendingCopy
+		{
+			VkBuffer		dstBuffer;
+			VkBufferCopy	region;
+		};
+
+		struct SubmittedCommandBuffer
+		{
+			VkCommandBuffer	commandBuffer;
+			uint64_t		value;
+		};
+
+		VulkanDevice*						m_pDevice = nullptr;
+		QueueTimeline*						m_pTimeline = nullptr;
+		uint32_t							m_QueueFamilyId{};
+		VkDeviceSize						m_Capacity{};
+		VkBuffer							m_Buffer = VK_NULL_HANDLE;
+		Allocation							m_Allocation{};
+		char*								m_pMappedMemory = nullptr;
+		VkCommandPool						m_CommandPool = VK_NULL_HANDLE;
+
+		VkDeviceSize						m_Head{ 0 };
+		std::deque<Region>					m_Regions{};
+		std::vector<PendingCopy>			m_PendingCopies{};
+		std::deque<SubmittedCommandBuffer>	m_CommandBuffers{};
+	};
+}
@@ -0,0 +1,192 @@
+#include "TemporalReprojection.h"
+#include "VulkanHelpers.h"
+#include "VulkanDevice.h"
+#include "Buffer.h"
+#include "Texture.h"
+#include "Shader.h"
+#include "Helper.h"
+#include <string>
+
+TemporalReprojection::TemporalReprojection(vkw::VulkanDevice* pDevice, vkw::CommandPool* pCommandPool, VkDescriptorSetLayout sceneSetLayout, const VkSpecializationInfo* pSpecializationInfo, uint32_t width, uint32_t height, uint32_t frameCount)
+	:m_pDevice(pDevice)
+	,m_Width(width)
+	,m_Height(height)
+	,m_TraceWidth(width)
+	,m_TraceHeight(height)
+	,m_Dispatches(frameCount, VkDispatchIndirectCommand{})
+{
+	m_pHistoryImage = new vkw::Texture(m_pDevice, pCommandPool, VK_IMAGE_USAGE_STORAGE_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_LAYOUT_GENERAL, nullptr, m_Width, m_Height, 1, VK_FORMAT_R32G32B32A32_SFLOAT);
+	m_pHistoryMomentBuffer = new vkw::Buffer(
+		m_pDevice, pCommandPool,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		size_t(m_Width * m_Height * sizeof(float)), nullptr
+	);
+
+	m_pDispatchBuffer = new vkw::Buffer(m_pDevice, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, sizeof(VkDispatchIndirectCommand), frameCount);
+	const VkDispatchIndirectCommand dispatch{};
+	for (uint32_t frame = 0; frame < frameCount; frame++)
+	{
+		m_pDispatchBuffer->UpdateSlice(frame, &dispatch, sizeof(VkDispatchIndirectCommand));
+	}
+
+	CreateDescriptorSet();
+	CreatePipelines(sceneSetLayout, pSpecializationInfo);
+}
+
+TemporalReprojection::~TemporalReprojection()
+{
+	for (VkPipeline pipeline : m_Pipelines)
+	{
+		vkDestroyPipeline(m_pDevice->GetDevice(), pipeline, nullptr);
+	}
+	vkDestroyPipelineLayout(m_pDevice->GetDevice(), m_PipelineLayout, nullptr);
+	vkDestroyDescriptorPool(m_pDevice->GetDevice(), m_DescriptorPool, nullptr);
+	vkDestroyDescriptorSetLayout(m_pDevice->GetDevice(), m_DescriptorSetLayout, nullptr);
+
+	delete m_pHistoryImage;
+	delete m_pHistoryMomentBuffer;
+	delete m_pDispatchBuffer;
+}
+
+void TemporalReprojection::RecordReprojection(VkCommandBuffer commandBuffer, VkDescriptorSet sceneSet, uint32_t uniformOffset, uint32_t frame)
+{
+	// Waits for the bvh build and the previous frame before the reprojection, and for the reprojection before the resolve and the trace
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	std::array<VkDescriptorSet, 2> descriptorSets{ sceneSet, m_DescriptorSet };
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_PipelineLayout, 0, descriptorSets.size(), descriptorSets.data(), 1, &uniformOffset);
+
+	for (VkPipeline pipeline : m_Pipelines)
+	{
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+		vkCmdDispatchIndirect(commandBuffer, m_pDispatchBuffer->GetDescriptor().buffer, m_pDispatchBuffer->GetSliceOffset(frame));
+	}
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void TemporalReprojection::SetEnabled(uint32_t frame, bool enabled)
+{
+	VkDispatchIndirectCommand dispatch{};
+	if (enabled)
+	{
+		dispatch = { (m_TraceWidth + WorkGroupSize - 1) / WorkGroupSize, (m_TraceHeight + WorkGroupSize - 1) / WorkGroupSize, 1 };
+	}
+	const VkDispatchIndirectCommand& current = m_Dispatches[frame];
+	if (dispatch.x == current.x && dispatch.y == current.y && dispatch.z == current.z)
+		return;
+
+	m_pDispatchBuffer->UpdateSlice(frame, &dispatch, sizeof(VkDispatchIndirectCommand));
+	m_Dispatches[frame] = dispatch;
+}
+
+void TemporalReprojection::SetTraceSize(uint32_t width, uint32_t height)
+{
+	m_TraceWidth = width;
+	m_TraceHeight = height;
+}
+
+void TemporalReprojection::CreateDescriptorSet()
+{
+	std::array<VkDescriptorSetLayoutBinding, 2> setLayoutBindings{};
+	setLayoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	setLayoutBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	setLayoutBindings[0].binding = 0;
+	setLayoutBindings[0].descriptorCount = 1;
+
+	setLayoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	setLayoutBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	setLayoutBindings[1].binding = 1;
+	setLayoutBindings[1].descriptorCount = 1;
+
+	VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo{};
+	descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	descriptorSetLayoutCreateInfo.pBindings = setLayoutBindings.data();
+	descriptorSetLayoutCreateInfo.bindingCount = setLayoutBindings.size();
+
+	ErrorCheck(vkCreateDescriptorSetLayout(m_pDevice->GetDevice(), &descriptorSetLayoutCreateInfo, nullptr, &m_DescriptorSetLayout));
+
+	std::array<VkDescriptorPoolSize, 2> poolSizes{};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	poolSizes[0].descriptorCount = 1;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[1].descriptorCount = 1;
+
+	VkDescriptorPoolCreateInfo descriptorPoolInfo{};
+	descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptorPoolInfo.poolSizeCount = poolSizes.size();
+	descriptorPoolInfo.pPoolSizes = poolSizes.data();
+	descriptorPoolInfo.maxSets = 1;
+
+	ErrorCheck(vkCreateDescriptorPool(m_pDevice->GetDevice(), &descriptorPoolInfo, nullptr, &m_DescriptorPool));
+
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = m_DescriptorPool;
+	allocInfo.pSetLayouts = &m_DescriptorSetLayout;
+	allocInfo.descriptorSetCount = 1;
+
+	ErrorCheck(vkAllocateDescriptorSets(m_pDevice->GetDevice(), &allocInfo, &m_DescriptorSet));
+
+	VkDescriptorImageInfo imageInfo = m_pHistoryImage->GetDescriptor();
+	VkDescriptorBufferInfo bufferInfo = m_pHistoryMomentBuffer->GetDescriptor();
+
+	std::array<VkWriteDescriptorSet, 2> writeDescriptorSets{};
+	writeDescriptorSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	writeDescriptorSets[0].descriptorCount = 1;
+	writeDescriptorSets[0].dstBinding = 0;
+	writeDescriptorSets[0].dstSet = m_DescriptorSet;
+	writeDescriptorSets[0].pImageInfo = &imageInfo;
+
+	writeDescriptorSets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	writeDescriptorSets[1].descriptorCount = 1;
+	writeDescriptorSets[1].dstBinding = 1;
+	writeDescriptorSets[1].dstSet = m_DescriptorSet;
+	writeDescriptorSets[1].pBufferInfo = &bufferInfo;
+
+	vkUpdateDescriptorSets(m_pDevice->GetDevice(), writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
+}
+
+void TemporalReprojection::CreatePipelines(VkDescriptorSetLayout sceneSetLayout, const VkSpecializationInfo* pSpecializationInfo)
+{
+	std::array<VkDescriptorSetLayout, 2> setLayouts{ sceneSetLayout, m_DescriptorSetLayout };
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{};
+	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutCreateInfo.pSetLayouts = setLayouts.data();
+	pipelineLayoutCreateInfo.setLayoutCount = setLayouts.size();
+
+	ErrorCheck(vkCreatePipelineLayout(m_pDevice->GetDevice(), &pipelineLayoutCreateInfo, nullptr, &m_PipelineLayout));
+
+	// Both passes are compiled from reproject.comp with their own define, see generate-spirv.bat
+	const std::array<std::string, PassCount> shaderFiles{
+		"Shaders/reproject.comp.spv",
+		"Shaders/reproject_resolve.comp.spv"
+	};
+
+	for (uint32_t pass = 0; pass < PassCount; pass++)
+	{
+		VkShaderModule shaderModule = CreateShaderModule(readFile(shaderFiles[pass]), m_pDevice->GetDevice());
+
+		VkPipelineShaderStageCreateInfo shaderStageInfo{};
+		shaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		shaderStageInfo.module = shaderModule;
+		shaderStageInfo.pName = "main";
+		shaderStageInfo.pSpecializationInfo = pSpecializationInfo;
+
+		VkComputePipelineCreateInfo computePipelineCreateInfo{};
+		computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		computePipelineCreateInfo.layout = m_PipelineLayout;
+		computePipelineCreateInfo.flags = 0;
+		computePipelineCreateInfo.stage = shaderStageInfo;
+
+		ErrorCheck(vkCreateComputePipelines(m_pDevice->GetDevice(), VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &m_Pipelines[pass]));
+
+		vkDestroyShaderModule(m_pDevice->GetDevice(), shaderModule, nullptr);
+	}
+}
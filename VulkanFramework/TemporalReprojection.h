@@ -0,0 +1,65 @@
+#pragma once
+#include "Platform.h"
+#include <array>
+#include <vector>
+
+namespace vkw
+{
+	class VulkanDevice;
+	class CommandPool;
+	class Buffer;
+	class Texture;
+}
+
+// Keeps the accumulated samples when the camera moves. The primary hit of every pixel in the new camera is projected into the
+// previous one, and the history there is kept where the previous primary hit (the feature buffer of the tracers) has the same id,
+// a similar normal and the expected depth. The history is written to its own image and copied back by a resolve pass,
+// since pixels read the accumulation of their neighbours.
+// Both passes are dispatched indirect, so frames without camera motion only pay for two empty dispatches.
+// The scene is read through the descriptor set of the megakernel, which is bound as set 0.
+class TemporalReprojection
+{
+public:
+	TemporalReprojection(vkw::VulkanDevice* pDevice, vkw::CommandPool* pCommandPool, VkDescriptorSetLayout sceneSetLayout, const VkSpecializationInfo* pSpecializationInfo, uint32_t width, uint32_t height, uint32_t frameCount);
+	~TemporalReprojection();
+
+	// Records both passes, they have to come before the trace in the same command buffer.
+	// Every frame in flight has its own dispatch arguments, so they can change while other frames are still executing.
+	void RecordReprojection(VkCommandBuffer commandBuffer, VkDescriptorSet sceneSet, uint32_t uniformOffset, uint32_t frame);
+	// Enables or skips the passes of the next submit of the frame, the previous camera is taken from the uniform buffer
+	void SetEnabled(uint32_t frame, bool enabled);
+	// Only the traced rectangle is reprojected, it is picked up by the next SetEnabled of every frame
+	void SetTraceSize(uint32_t width, uint32_t height);
+
+	static const uint32_t	WorkGroupSize{ 16 };
+
+private:
+	enum Pass
+	{
+		ReprojectPass,
+		ResolvePass,
+		PassCount
+	};
+
+	void CreateDescriptorSet();
+	void CreatePipelines(VkDescriptorSetLayout sceneSetLayout, const VkSpecializationInfo* pSpecializationInfo);
+
+	vkw::VulkanDevice*					m_pDevice = nullptr;
+	uint32_t							m_Width{};
+	uint32_t							m_Height{};
+	uint32_t							m_TraceWidth{};
+	uint32_t							m_TraceHeight{};
+	// Dispatch arguments last written to the slot of every frame
+	std::vector<VkDispatchIndirectCommand>	m_Dispatches{};
+
+	vkw::Texture*						m_pHistoryImage = nullptr;
+	vkw::Buffer*						m_pHistoryMomentBuffer = nullptr;
+	// Host visible VkDispatchIndirectCommand of both passes per frame in flight, empty while disabled
+	vkw::Buffer*						m_pDispatchBuffer = nullptr;
+
+	VkDescriptorPool					m_DescriptorPool = VK_NULL_HANDLE;
+	VkDescriptorSetLayout				m_DescriptorSetLayout = VK_NULL_HANDLE;
+	VkDescriptorSet						m_DescriptorSet = VK_NULL_HANDLE;
+	VkPipelineLayout					m_PipelineLayout = VK_NULL_HANDLE;
+	std::array<VkPipeline, PassCount>	m_Pipelines{};
+};
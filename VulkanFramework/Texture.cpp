@@ -5,8 +5,8 @@
 #include <algorithm>
 using namespace vkw;
 
-Texture::Texture(VulkanDevice* pDevice, CommandPool* cmdPool, VkImageUsageFlags usageFlags, VkMemoryPropertyFlags memPropFlags, VkImageLayout imageLayout, void* data, uint32_t width, uint32_t height, uint32_t layers)
-	:m_ImageLayout(imageLayout), m_pDevice(pDevice), m_Width(width), m_Height(height), m_Layers(layers)
+Texture::Texture(VulkanDevice* pDevice, CommandPool* cmdPool, VkImageUsageFlags usageFlags, VkMemoryPropertyFlags memPropFlags, VkImageLayout imageLayout, void* data, uint32_t width, uint32_t height, uint32_t layers, VkFormat format)
+	:m_ImageLayout(imageLayout), m_pDevice(pDevice), m_Width(width), m_Height(height), m_Layers(layers), m_Format(format)
 {
 	Init(cmdPool, usageFlags, memPropFlags, data);
 }
@@ -47,38 +47,40 @@ uint32_t vkw::Texture::GetLayers()
 	return m_Layers;
 }
 
+VkFormat vkw::Texture::GetFormat()
+{
+	return m_Format;
+}
+
 
 void vkw::Texture::Init(CommandPool* cmdPool, VkImageUsageFlags usageFlags, VkMemoryPropertyFlags memPropFlags, void* data)
 {
-	CreateImage(m_pDevice->GetDevice(), m_pDevice->GetPhysicalDeviceMemoryProperties(), m_Width, m_Height, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, usageFlags, memPropFlags, m_Image, m_DeviceMemory, m_Layers);
+	CreateImage(m_pDevice->GetDevice(), m_pDevice->GetAllocator(), m_Width, m_Height, m_Format, VK_IMAGE_TILING_OPTIMAL, usageFlags, memPropFlags, m_Image, m_Allocation, m_Layers);
 
 
 
 	if(data != nullptr)
 	{
 		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingBufferMemory;
+		Allocation stagingAllocation;
 		VkDeviceSize imageSize = m_Width * m_Height * 4;
 
-		CreateBuffer(m_pDevice->GetDevice(), m_pDevice->GetPhysicalDeviceMemoryProperties(), imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+		CreateBuffer(m_pDevice->GetDevice(), m_pDevice->GetAllocator(), imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingAllocation);
 
-		void* mappedMemory;
-		vkMapMemory(m_pDevice->GetDevice(), stagingBufferMemory, 0, imageSize, 0, &mappedMemory);
-		memcpy(mappedMemory, data, static_cast<size_t>(imageSize));
-		vkUnmapMemory(m_pDevice->GetDevice(), stagingBufferMemory);
+		memcpy(stagingAllocation.pMappedData, data, static_cast<size_t>(imageSize));
 
-		TransitionImageLayout(m_pDevice->GetDevice(), m_pDevice->GetQueue(), cmdPool->GetHandle(), m_Image, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+		TransitionImageLayout(m_pDevice->GetDevice(), m_pDevice->GetQueue(), cmdPool->GetHandle(), m_Image, m_Format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
 		CopyBufferToImage(m_pDevice->GetDevice(), m_pDevice->GetQueue(), cmdPool->GetHandle(), stagingBuffer, m_Image, m_Width, m_Height);
 
 		vkDestroyBuffer(m_pDevice->GetDevice(), stagingBuffer, nullptr);
-		vkFreeMemory(m_pDevice->GetDevice(), stagingBufferMemory, nullptr);
+		m_pDevice->GetAllocator()->Free(stagingAllocation);
 
-		TransitionImageLayout(m_pDevice->GetDevice(), m_pDevice->GetQueue(), cmdPool->GetHandle(), m_Image, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, m_ImageLayout);
+		TransitionImageLayout(m_pDevice->GetDevice(), m_pDevice->GetQueue(), cmdPool->GetHandle(), m_Image, m_Format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, m_ImageLayout);
 		return;
 	}
 
-	TransitionImageLayout(m_pDevice->GetDevice(), m_pDevice->GetQueue(), cmdPool->GetHandle(), m_Image, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_UNDEFINED, m_ImageLayout, m_Layers);
+	TransitionImageLayout(m_pDevice->GetDevice(), m_pDevice->GetQueue(), cmdPool->GetHandle(), m_Image, m_Format, VK_IMAGE_LAYOUT_UNDEFINED, m_ImageLayout, m_Layers);
 
 	VkSamplerCreateInfo samplerCreateInfo{};
 	samplerCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
@@ -102,7 +104,7 @@ void vkw::Texture::Init(CommandPool* cmdPool, VkImageUsageFlags usageFlags, VkMe
 	imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
 	if(m_Layers > 1)
 		imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
-	imageViewCreateInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+	imageViewCreateInfo.format = m_Format;
 	imageViewCreateInfo.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
 	imageViewCreateInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
 	imageViewCreateInfo.subresourceRange.layerCount = m_Layers;
@@ -119,7 +121,7 @@ void vkw::Texture::Cleanup()
 	vkDestroySampler(m_pDevice->GetDevice(), m_Sampler, nullptr);
 	vkDestroyImageView(m_pDevice->GetDevice(), m_ImageView, nullptr);
 	vkDestroyImage(m_pDevice->GetDevice(), m_Image, nullptr);
-	vkFreeMemory(m_pDevice->GetDevice(), m_DeviceMemory, nullptr);
+	m_pDevice->GetAllocator()->Free(m_Allocation);
 }
 
 void vkw::Texture::CopyTo(Texture * texture, VkCommandPool cmdPool, uint32_t sourceLayer, uint32_t destLayer)
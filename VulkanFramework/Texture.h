@@ -1,5 +1,6 @@
 #pragma once
 #include "Platform.h"
+#include "MemoryAllocator.h"
 namespace vkw
 {
 	class CommandPool;
@@ -7,7 +8,7 @@ namespace vkw
 	class Texture
 	{
 	public:
-		Texture(VulkanDevice* pDevice, CommandPool* cmdPool, VkImageUsageFlags usageFlags, VkMemoryPropertyFlags memPropFlags, VkImageLayout imageLayout, void* data, uint32_t width, uint32_t height, uint32_t layers = 1);
+		Texture(VulkanDevice* pDevice, CommandPool* cmdPool, VkImageUsageFlags usageFlags, VkMemoryPropertyFlags memPropFlags, VkImageLayout imageLayout, void* data, uint32_t width, uint32_t height, uint32_t layers = 1, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM);
 		~Texture();
 
 		VkDescriptorImageInfo GetDescriptor();
@@ -16,6 +17,7 @@ namespace vkw
 		uint32_t GetWidth();
 		uint32_t GetHeight();
 		uint32_t GetLayers();
+		VkFormat GetFormat();
 		void CopyTo(Texture* texture, VkCommandPool cmdPool, uint32_t sourceLayer = 0, uint32_t destLayer = 0);
 
 	private:
@@ -27,9 +29,11 @@ namespace vkw
 		VulkanDevice*			m_pDevice;
 		VkImage					m_Image;
 		VkImageLayout			m_ImageLayout;
-		VkDeviceMemory			m_DeviceMemory;
+		Allocation				m_Allocation;
 		VkImageView				m_ImageView;
 		uint32_t				m_Width, m_Height, m_Layers;
+		// Initial data is only supported for 4 byte formats
+		VkFormat				m_Format;
 		VkDescriptorImageInfo	m_Descriptor;
 		VkSampler				m_Sampler;
 	};
@@ -0,0 +1,136 @@
+#include "ThreadPool.h"
+
+namespace
+{
+	thread_local const ThreadPool*	t_pCurrentPool = nullptr;
+	thread_local uint32_t			t_QueueIndex = 0;
+}
+
+ThreadPool::ThreadPool(uint32_t workerCount)
+{
+	//One queue per worker, the last queue is shared by all threads outside of the pool
+	for (uint32_t i = 0; i < workerCount + 1; i++)
+	{
+		m_Queues.push_back(std::make_unique<TaskQueue>());
+	}
+
+	m_Workers.reserve(workerCount);
+	for (uint32_t i = 0; i < workerCount; i++)
+	{
+		m_Workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_SleepMutex);
+		m_IsRunning = false;
+	}
+	m_SleepCondition.notify_all();
+	for (std::thread& worker : m_Workers)
+	{
+		worker.join();
+	}
+}
+
+void ThreadPool::Submit(TaskGroup& group, std::function<void()> task)
+{
+	group.m_PendingTasks++;
+	TaskQueue& queue = *m_Queues[GetQueueIndex()];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.tasks.push_back(Task{ std::move(task), &group });
+	}
+	m_QueuedTasks++;
+
+	//Taking the sleep mutex makes sure a worker can't miss the notification between checking for work and going to sleep
+	{
+		std::lock_guard<std::mutex> lock(m_SleepMutex);
+	}
+	m_SleepCondition.notify_one();
+}
+
+void ThreadPool::Wait(TaskGroup& group)
+{
+	uint32_t queueIndex = GetQueueIndex();
+	while (!group.IsDone())
+	{
+		if (!TryRunTask(queueIndex))
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+uint32_t ThreadPool::GetWorkerCount() const
+{
+	return uint32_t(m_Workers.size());
+}
+
+uint32_t ThreadPool::GetDefaultWorkerCount()
+{
+	uint32_t coreCount = std::thread::hardware_concurrency();
+	return (coreCount > 1) ? coreCount - 1 : 0;
+}
+
+void ThreadPool::WorkerLoop(uint32_t queueIndex)
+{
+	t_pCurrentPool = this;
+	t_QueueIndex = queueIndex;
+	while (m_IsRunning)
+	{
+		if (TryRunTask(queueIndex))
+			continue;
+
+		std::unique_lock<std::mutex> lock(m_SleepMutex);
+		m_SleepCondition.wait(lock, [this]() { return m_QueuedTasks.load() > 0 || !m_IsRunning; });
+	}
+}
+
+bool ThreadPool::TryRunTask(uint32_t queueIndex)
+{
+	Task task{};
+	if (!TryPop(queueIndex, task) && !TrySteal(queueIndex, task))
+		return false;
+
+	m_QueuedTasks--;
+	task.function();
+	task.pGroup->m_PendingTasks--;
+	return true;
+}
+
+bool ThreadPool::TryPop(uint32_t queueIndex, Task& task)
+{
+	//Newest task first, it is the most likely to still have its data in cache
+	TaskQueue& queue = *m_Queues[queueIndex];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.tasks.empty())
+		return false;
+	task = std::move(queue.tasks.back());
+	queue.tasks.pop_back();
+	return true;
+}
+
+bool ThreadPool::TrySteal(uint32_t queueIndex, Task& task)
+{
+	//Oldest task first, those tend to be the biggest chunks of work
+	for (size_t offset = 1; offset < m_Queues.size(); offset++)
+	{
+		TaskQueue& queue = *m_Queues[(queueIndex + offset) % m_Queues.size()];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty())
+			continue;
+		task = std::move(queue.tasks.front());
+		queue.tasks.pop_front();
+		return true;
+	}
+	return false;
+}
+
+uint32_t ThreadPool::GetQueueIndex() const
+{
+	if (t_pCurrentPool == this)
+		return t_QueueIndex;
+	return uint32_t(m_Queues.size() - 1);
+}
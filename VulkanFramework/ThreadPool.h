@@ -0,0 +1,63 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work stealing thread pool. Every worker owns a deque it pushes and pops at the back,
+// idle workers steal from the front of the other deques. Threads that are not part of the pool
+// submit to a shared deque and help executing tasks while they wait for a TaskGroup.
+class ThreadPool
+{
+public:
+	class TaskGroup
+	{
+	public:
+		bool IsDone() const { return m_PendingTasks.load() == 0; }
+	private:
+		friend class ThreadPool;
+		std::atomic<uint32_t> m_PendingTasks{ 0 };
+	};
+
+	// The calling thread helps out while waiting, so by default one worker less than there are cores
+	explicit ThreadPool(uint32_t workerCount = GetDefaultWorkerCount());
+	~ThreadPool();
+
+	void Submit(TaskGroup& group, std::function<void()> task);
+	// Runs queued tasks on the calling thread until every task of the group finished
+	void Wait(TaskGroup& group);
+	uint32_t GetWorkerCount() const;
+
+	static uint32_t GetDefaultWorkerCount();
+
+private:
+	struct Task
+	{
+		std::function<void()> function;
+		TaskGroup* pGroup;
+	};
+
+	struct TaskQueue
+	{
+		std::deque<Task> tasks;
+		std::mutex mutex;
+	};
+
+	void WorkerLoop(uint32_t queueIndex);
+	bool TryRunTask(uint32_t queueIndex);
+	bool TryPop(uint32_t queueIndex, Task& task);
+	bool TrySteal(uint32_t queueIndex, Task& task);
+	uint32_t GetQueueIndex() const;
+
+	std::vector<std::unique_ptr<TaskQueue>>	m_Queues{};
+	std::vector<std::thread>				m_Workers{};
+	std::atomic<uint32_t>					m_QueuedTasks{ 0 };
+	std::atomic<bool>						m_IsRunning{ true };
+	std::mutex								m_SleepMutex{};
+	std::condition_variable					m_SleepCondition{};
+};
+
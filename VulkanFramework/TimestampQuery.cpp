@@ -0,0 +1,73 @@
+#include "TimestampQuery.h"
+#include "VulkanDevice.h"
+#include "VulkanHelpers.h"
+
+using namespace vkw;
+
+TimestampQuery::TimestampQuery(VulkanDevice* pDevice, uint32_t count)
+	:m_pDevice(pDevice), m_Count(count)
+{
+	Init();
+}
+
+TimestampQuery::~TimestampQuery()
+{
+	Cleanup();
+}
+
+void TimestampQuery::Reset(VkCommandBuffer commandBuffer)
+{
+	if (!m_IsSupported)
+		return;
+	vkCmdResetQueryPool(commandBuffer, m_QueryPool, 0, m_Count);
+}
+
+void TimestampQuery::Write(VkCommandBuffer commandBuffer, VkPipelineStageFlagBits stage, uint32_t index)
+{
+	if (!m_IsSupported)
+		return;
+	vkCmdWriteTimestamp(commandBuffer, stage, m_QueryPool, index);
+}
+
+bool TimestampQuery::FetchResults()
+{
+	if (!m_IsSupported)
+		return false;
+	VkResult result = vkGetQueryPoolResults(m_pDevice->GetDevice(), m_QueryPool, 0, m_Count, m_Results.size() * sizeof(uint64_t), m_Results.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+	if (result == VK_NOT_READY)
+		return false;
+	ErrorCheck(result);
+	return true;
+}
+
+float TimestampQuery::GetMilliseconds(uint32_t begin, uint32_t end) const
+{
+	return float(m_Results[end] - m_Results[begin]) * m_TimestampPeriod / 1000000.f;
+}
+
+bool TimestampQuery::IsSupported() const
+{
+	return m_IsSupported;
+}
+
+void TimestampQuery::Init()
+{
+	const VkPhysicalDeviceLimits& limits = m_pDevice->GetPhysicalDeviceProperties().limits;
+	m_IsSupported = limits.timestampComputeAndGraphics == VK_TRUE;
+	m_TimestampPeriod = limits.timestampPeriod;
+	m_Results.resize(m_Count);
+	if (!m_IsSupported)
+		return;
+
+	VkQueryPoolCreateInfo queryPoolCreateInfo{};
+	queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	queryPoolCreateInfo.queryCount = m_Count;
+
+	ErrorCheck(vkCreateQueryPool(m_pDevice->GetDevice(), &queryPoolCreateInfo, nullptr, &m_QueryPool));
+}
+
+void TimestampQuery::Cleanup()
+{
+	vkDestroyQueryPool(m_pDevice->GetDevice(), m_QueryPool, nullptr);
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "Platform.h"
+#include <vector>
+
+namespace vkw
+{
+	class VulkanDevice;
+	// Pool of gpu timestamps. Reset and write them while recording, read them back once the command buffer finished executing.
+	class TimestampQuery
+	{
+	public:
+		TimestampQuery(VulkanDevice* pDevice, uint32_t count);
+		~TimestampQuery();
+
+		void Reset(VkCommandBuffer commandBuffer);
+		void Write(VkCommandBuffer commandBuffer, VkPipelineStageFlagBits stage, uint32_t index);
+		// Returns false while the results are not available yet
+		bool FetchResults();
+		// Time between two written timestamps of the last fetched results
+		float GetMilliseconds(uint32_t begin, uint32_t end) const;
+		bool IsSupported() const;
+
+	private:
+		void Init();
+		void Cleanup();
+
+		VulkanDevice*				m_pDevice = nullptr;
+		VkQueryPool					m_QueryPool = VK_NULL_HANDLE;
+		uint32_t					m_Count{};
+		float						m_TimestampPeriod{};
+		bool						m_IsSupported{ false };
+		std::vector<uint64_t>		m_Results{};
+	};
+}
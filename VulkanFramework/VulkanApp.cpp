@@ -11,8 +11,25 @@
 #include "RenderPass.h"
 #include "CommandPool.h"
 #include "FrameBuffer.h"
+#include "BVH.h"
+#include "ThreadPool.h"
+#include "LBVHBuilder.h"
+#include "TimestampQuery.h"
+#include "WavefrontTracer.h"
+#include "Denoiser.h"
+#include "TemporalReprojection.h"
+#include "QueueTimeline.h"
+#include "StagingRing.h"
 #include <sstream>
+#include <fstream>
+#include <limits>
+#include <cstddef>
+#include <map>
 #include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <iostream>
+#include <thread>
 #include <gli/gli.hpp>
 
 VulkanApp::VulkanApp(vkw::VulkanDevice* pDevice):VulkanBaseApp(pDevice, "Raytracing")
@@ -26,38 +43,66 @@ VulkanApp::~VulkanApp()
 
 void VulkanApp::Render()
 {
-	GetSwapchain()->AcquireNextImage(GetPresentCompleteSemaphore());
-	VkSubmitInfo submitInfo{};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = &GetPresentCompleteSemaphore();
-	VkPipelineStageFlags waitDstMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	submitInfo.pWaitDstStageMask = &waitDstMask;
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = &GetRenderCompleteSemaphore();
-	submitInfo.pCommandBuffers = &GetDrawCommandBuffers()[GetSwapchain()->GetActiveImageId()];
-	submitInfo.commandBufferCount = 1;
+	const uint32_t frame = m_CurrentFrame;
+
+	// Only the frame that used this slot before has to be traced and composited before its uniform slice, timestamps,
+	// display image and command buffers are reused, the other frames in flight keep executing
+	m_pComputeTimeline->Wait(m_FrameComputeValues[frame]);
+	GetGraphicsTimeline()->Wait(m_FrameGraphicsValues[frame]);
+	m_pComputeTimeline->CollectGarbage();
+	GetGraphicsTimeline()->CollectGarbage();
+	ReportTraceTimings(frame);
+	UpdateInstances();
+	UpdateUniformBuffers();
+	if (m_InstanceDescriptorsDirty[frame])
+	{
+		// Rewriting the set invalidates the command buffer that binds it
+		WriteInstanceDescriptors(frame);
+		m_InstanceDescriptorsDirty[frame] = false;
+		m_ComputeCommandBufferDirty[frame] = true;
+	}
+	if (m_ComputeCommandBufferDirty[frame])
+	{
+		// The slot was waited on above, the other frames in flight are recorded again once their slot comes up
+		RecordComputeCommandBuffer(frame);
+		m_ComputeCommandBufferDirty[frame] = false;
+	}
 
-	ErrorCheck(vkQueueSubmit(GetDevice()->GetQueue(), 1, &submitInfo, VK_NULL_HANDLE));
+	// The buffers updated since the last frame are copied on the same queue, before the trace reads them
+	m_pStagingRing->Flush();
+	if (m_SphereBVHBuildPending)
+	{
+		SubmitSphereBVHBuild(frame);
+	}
+	const uint64_t traceValue = m_pComputeTimeline->Submit(m_ComputeCommandBuffers[frame]);
+	m_FrameComputeValues[frame] = traceValue;
 
-	GetSwapchain()->PresentImage(GetRenderCompleteSemaphore());
-	ErrorCheck(vkQueueWaitIdle(GetDevice()->GetQueue()));
+	// The composite waits on the gpu for the trace, so the next frame can be traced while this one is composited and presented
+	uint32_t imageIndex = GetSwapchain()->AcquireNextImage(GetPresentCompleteSemaphore(frame));
+	RecordDrawCommandBuffer(frame, imageIndex);
 
-	vkWaitForFences(GetDevice()->GetDevice(), 1, &m_ComputeFence, VK_TRUE, UINT64_MAX);
-	vkResetFences(GetDevice()->GetDevice(), 1, &m_ComputeFence);
+	m_FrameGraphicsValues[frame] = GetGraphicsTimeline()->Submit(
+		GetDrawCommandBuffers()[frame],
+		{
+			{ GetPresentCompleteSemaphore(frame), 0, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT },
+			m_pComputeTimeline->WaitFor(traceValue, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT)
+		},
+		{ GetRenderCompleteSemaphore(frame) }
+	);
 
-	VkSubmitInfo computeSubmitInfo{};
-	computeSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	computeSubmitInfo.commandBufferCount = 1;
-	computeSubmitInfo.pCommandBuffers = &m_ComputeCommandBuffer;
+	GetSwapchain()->PresentImage(GetRenderCompleteSemaphore(frame));
 
-	ErrorCheck(vkQueueSubmit(m_ComputeQueue, 1, &computeSubmitInfo, m_ComputeFence));
+	m_TraceSubmits[frame] = TraceSubmit{ true, m_UniformBufferData.traceFlags, m_TraceMode, m_DenoiseEnabled, m_UniformBufferData.traceSize.x * m_UniformBufferData.traceSize.y };
+	m_CurrentFrame = (m_CurrentFrame + 1) % GetFramesInFlight();
 }
 
 bool VulkanApp::Update(float dTime)
 {
 	m_AccuTime += dTime;
-	//UpdateSpheres();
+	if (m_AnimateSpheres)
+	{
+		UpdateSpheres();
+	}
 	if(GetWindow()->IsKeyButtonDown('W'))
 	{
 		m_UniformBufferData.pos += dTime * 5 * m_UniformBufferData.forward;
@@ -83,7 +128,53 @@ bool VulkanApp::Update(float dTime)
 		m_UniformBufferData.pos.y -= dTime * 5;
 	}
 	
+	bool isAnimateToggleDown = GetWindow()->IsKeyButtonDown('G');
+	if (isAnimateToggleDown && !m_WasAnimateToggleDown)
+	{
+		m_AnimateSpheres = !m_AnimateSpheres;
+	}
+	m_WasAnimateToggleDown = isAnimateToggleDown;
+
+	bool isBVHToggleDown = GetWindow()->IsKeyButtonDown('B');
+	if (isBVHToggleDown && !m_WasBVHToggleDown)
+	{
+		// Wide spheres are only available while their bvh is built on the cpu
+		uint32_t wideFlags = (m_pSphereLBVHBuilder == nullptr) ? WideTriangleBVH | WideSphereBVH : WideTriangleBVH;
+		m_UniformBufferData.traceFlags ^= wideFlags;
+	}
+	m_WasBVHToggleDown = isBVHToggleDown;
+
+	bool isTraceModeToggleDown = GetWindow()->IsKeyButtonDown('M');
+	if (isTraceModeToggleDown && !m_WasTraceModeToggleDown)
+	{
+		m_TraceMode = TraceMode((m_TraceMode + 1) % TraceModeCount);
+		m_ComputeCommandBufferDirty.assign(m_ComputeCommandBufferDirty.size(), true);
+	}
+	m_WasTraceModeToggleDown = isTraceModeToggleDown;
+
+	bool isDenoiseToggleDown = GetWindow()->IsKeyButtonDown('F');
+	if (isDenoiseToggleDown && !m_WasDenoiseToggleDown)
+	{
+		m_DenoiseEnabled = !m_DenoiseEnabled;
+		m_ComputeCommandBufferDirty.assign(m_ComputeCommandBufferDirty.size(), true);
+	}
+	m_WasDenoiseToggleDown = isDenoiseToggleDown;
+
+	bool isReprojectToggleDown = GetWindow()->IsKeyButtonDown('T');
+	if (isReprojectToggleDown && !m_WasReprojectToggleDown)
+	{
+		m_ReprojectEnabled = !m_ReprojectEnabled;
+	}
+	m_WasReprojectToggleDown = isReprojectToggleDown;
 
+	bool isDynamicResolutionToggleDown = GetWindow()->IsKeyButtonDown('R');
+	if (isDynamicResolutionToggleDown && !m_WasDynamicResolutionToggleDown)
+	{
+		m_DynamicResolution = !m_DynamicResolution;
+		if (!m_DynamicResolution)
+			SetResolutionScale(1.f);
+	}
+	m_WasDynamicResolutionToggleDown = isDynamicResolutionToggleDown;
 
 	glm::vec2 mouseMovement{ GetWindow()->GetMousePos() - m_PrevMousePosition };
 	m_PrevMousePosition = GetWindow()->GetMousePos();
@@ -106,7 +197,7 @@ bool VulkanApp::Update(float dTime)
 		m_UniformBufferData.forward = glm::normalize(m_UniformBufferData.forward);
 	}
 
-	UpdateUniformBuffers();
+	// The instances and uniform buffers are written by Render, once the trace reading them finished
 	return VulkanBaseApp::Update(dTime);
 }
 
@@ -114,37 +205,59 @@ bool VulkanApp::Update(float dTime)
 void VulkanApp::Init(float width, float height)
 {
 	VulkanBaseApp::Init(width, height);
+	m_pThreadPool = new ThreadPool();
 	CreateStorageBuffers();
 	CreateUniformBuffers();
 	UpdateUniformBuffers();
-	CreateSampleTextures();
+	CreateAccumulationTexture();
 	CreateCubeMap();
 	CreateGraphicsPipeline();
 	CreateDescriptorPool();
 	CreateDescriptorSet();
 	CreateComputePipeline();
-	BuildDrawCommandBuffers();
+	CreateDenoiser();
+	m_TimestampQueries.resize(GetFramesInFlight());
+	for (vkw::TimestampQuery*& pTimestampQuery : m_TimestampQueries)
+	{
+		pTimestampQuery = new vkw::TimestampQuery(GetDevice(), TimestampCount);
+	}
+	m_TraceSubmits.resize(GetFramesInFlight());
+	if (m_Autotune)
+	{
+		Autotune();
+	}
 	BuildComputeCommandBuffers();
+	PrintMemoryStats();
 }
 
 void VulkanApp::Cleanup()
 {
-	ErrorCheck(vkQueueWaitIdle(GetDevice()->GetQueue()));
-	ErrorCheck(vkQueueWaitIdle(m_ComputeQueue));
+	ErrorCheck(vkDeviceWaitIdle(GetDevice()->GetDevice()));
 	VulkanBaseApp::Cleanup();
+	DestroyDenoiser();
 	DestroyComputePipeline();
 	DestroyDescriptorPool();
 	DestroyGraphicsPipeline();
 	DestroyCubeMap();
-	DestroyTextureSamples();
+	DestroyAccumulationTexture();
 	DestroyUniformBuffers();
 	DestroyStorageBuffers();
+	for (vkw::TimestampQuery* pTimestampQuery : m_TimestampQueries)
+	{
+		delete pTimestampQuery;
+	}
+	delete m_pThreadPool;
 }
 
 void VulkanApp::CreateStorageBuffers()
 {
 	uint32_t currentId{0};
 
+	// Materials
+	uint32_t sphereMaterial = AddMaterial(Material{ glm::vec3(0.0f, 1.0f, 0.0f), 0.04f });
+	uint32_t planeMaterial = AddMaterial(Material{ glm::vec3(1.0f, 0.0f, 0.0f), 0.04f });
+	uint32_t meshMaterial = AddMaterial(Material{ glm::vec3(0.65f, 0.77f, 0.97f), 0.04f });
+
 	// Spheres
 	float rows{ 10 };
 	float cols{ 10 };
@@ -152,23 +265,49 @@ void VulkanApp::CreateStorageBuffers()
 	{
 		for (int c = 0; c < cols; c++)
 		{
-			m_Spheres.push_back(Sphere{ glm::vec3(-1.75f + (2.5f/cols)*c, 0.0f, 0.0f - ((2.5f/rows)*r)), (1.f/((rows > cols)? rows : cols)), glm::vec3(0.0f, 1.0f, 0.0f), ++currentId });
+			m_Spheres.push_back(Sphere{ glm::vec3(-1.75f + (2.5f/cols)*c, 0.0f, 0.0f - ((2.5f/rows)*r)), (1.f/((rows > cols)? rows : cols)), sphereMaterial, ++currentId });
 		}
 	}
 	
 
+	BuildSphereBVH();
+	PrintBVHStats("Spheres", m_SphereBVH, m_SphereWideBVH, m_Spheres.size());
+
+	// Room for the worst case node count so a rebuild never has to resize the buffer
+	m_pSphereBVHBuffer = new vkw::Buffer(
+		GetDevice(), GetCommandPool(),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		size_t((m_Spheres.size() * 2 - 1) * sizeof(BVHNode)), nullptr
+	);
+	m_pSphereBVHBuffer->Update((void*)m_SphereBVH.GetNodes().data(), m_SphereBVH.GetNodes().size() * sizeof(BVHNode), GetCommandPool());
+
+	// Every wide node replaces at least one of the n-1 interior binary nodes
+	m_pSphereWideBVHBuffer = new vkw::Buffer(
+		GetDevice(), GetCommandPool(),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		size_t(std::max(m_Spheres.size() - 1, size_t(1)) * sizeof(WideBVHNode)), nullptr
+	);
+	m_pSphereWideBVHBuffer->Update((void*)m_SphereWideBVH.GetNodes().data(), m_SphereWideBVH.GetNodes().size() * sizeof(WideBVHNode), GetCommandPool());
+
 	VkDeviceSize storageBufferSize = m_Spheres.size() * sizeof(Sphere);
 
 	m_pSphereGeomBuffer = new vkw::Buffer(
 		GetDevice(), GetCommandPool(),
-		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 		size_t(m_Spheres.size()*sizeof(Sphere)), (void*)m_Spheres.data()
 	);
 
+	if (m_BuildSphereBVHOnGPU)
+	{
+		m_pSphereLBVHBuilder = new LBVHBuilder(GetDevice(), GetCommandPool(), m_pSphereGeomBuffer, m_pSphereBVHBuffer, uint32_t(m_Spheres.size()));
+		m_SphereBVHBuildPending = true;
+	}
+	m_UniformBufferData.traceFlags = (m_pSphereLBVHBuilder == nullptr) ? WideTriangleBVH | WideSphereBVH : WideTriangleBVH;
+
 	// Planes
 	std::vector<Plane> planes;
 	const float roomDim = (1.f / ((rows > cols) ? rows : cols));
-	planes.push_back(Plane{ glm::vec3(0.0f, 1.0f, 0.0f), roomDim, glm::vec3(1.0f, 0.f, 0.f), ++currentId });
+	planes.push_back(Plane{ glm::vec3(0.0f, 1.0f, 0.0f), roomDim, planeMaterial, ++currentId });
 	storageBufferSize = planes.size() * sizeof(Plane);
 
 	m_pPlaneGeomBuffer = new vkw::Buffer(
@@ -177,29 +316,121 @@ void VulkanApp::CreateStorageBuffers()
 		size_t(planes.size() * sizeof(Plane)), (void*)planes.data()
 	);
 
-	std::vector<Triangle> triangles;
-	triangles = LoadModel("Models/Cube.obj", currentId);
+	// Meshes
+	uint32_t cubeMesh = LoadMesh("Models/Cube.obj", currentId, meshMaterial);
+	AddInstance(cubeMesh, glm::mat4(1.f));
 
-	m_pTriangleGeomBuffer = new vkw::Buffer(
+	m_pTriangleBVHBuffer = new vkw::Buffer(
 		GetDevice(), GetCommandPool(),
-		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		size_t(triangles.size()*sizeof(Triangle)), triangles.data()
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		size_t(m_MeshNodes.size() * sizeof(BVHNode)), (void*)m_MeshNodes.data()
+	);
+
+	m_pTriangleWideBVHBuffer = new vkw::Buffer(
+		GetDevice(), GetCommandPool(),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		size_t(m_MeshWideNodes.size() * sizeof(WideBVHNode)), (void*)m_MeshWideNodes.data()
 	);
+
+	m_pVertexBuffer = new vkw::Buffer(
+		GetDevice(), GetCommandPool(),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		size_t(m_MeshVertices.size() * sizeof(glm::vec4)), m_MeshVertices.data()
+	);
+
+	size_t indexedBytes = m_MeshVertices.size() * sizeof(glm::vec4) + m_MeshTriangles.size() * sizeof(glm::uvec4);
+	size_t precomputedBytes = m_MeshTriangles.size() * sizeof(PrecomputedTriangle);
+	std::cout << "Triangle geometry: " << m_MeshTriangles.size() << " triangles, " << m_MeshVertices.size() << " vertices"
+		<< "\tIndexed: " << float(indexedBytes) / m_MeshTriangles.size() << " bytes per triangle"
+		<< "\tPrecomputed: " << float(precomputedBytes) / m_MeshTriangles.size() << " bytes per triangle" << std::endl;
+
+	if (m_UsePrecomputedTriangles)
+	{
+		std::vector<PrecomputedTriangle> precomputedTriangles(m_MeshTriangles.size());
+		for (size_t i = 0; i < m_MeshTriangles.size(); i++)
+		{
+			const glm::uvec4& triangle = m_MeshTriangles[i];
+			glm::vec3 p1 = m_MeshVertices[triangle.x];
+			precomputedTriangles[i].p1 = p1;
+			precomputedTriangles[i].id = triangle.w;
+			precomputedTriangles[i].edge1 = glm::vec3(m_MeshVertices[triangle.y]) - p1;
+			precomputedTriangles[i].edge2 = glm::vec3(m_MeshVertices[triangle.z]) - p1;
+		}
+		m_pTriangleGeomBuffer = new vkw::Buffer(
+			GetDevice(), GetCommandPool(),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			size_t(precomputedTriangles.size() * sizeof(PrecomputedTriangle)), precomputedTriangles.data()
+		);
+		m_UniformBufferData.traceFlags |= PrecomputedTriangles;
+	}
+	else
+	{
+		m_pTriangleGeomBuffer = new vkw::Buffer(
+			GetDevice(), GetCommandPool(),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			size_t(m_MeshTriangles.size() * sizeof(glm::uvec4)), m_MeshTriangles.data()
+		);
+	}
+
+	m_pMaterialBuffer = new vkw::Buffer(
+		GetDevice(), GetCommandPool(),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		size_t(m_Materials.size() * sizeof(Material)), m_Materials.data()
+	);
+
+	m_pWorkCounterBuffer = new vkw::Buffer(
+		GetDevice(), GetCommandPool(),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		sizeof(uint32_t), nullptr
+	);
+
+	// Instances
+	UpdateInstances();
+
+	// Compute pipelines are specialized for the primitive types in the scene
+	m_TraceSpecialization.hasSpheres = m_Spheres.empty() ? VK_FALSE : VK_TRUE;
+	m_TraceSpecialization.hasPlanes = planes.empty() ? VK_FALSE : VK_TRUE;
+	m_TraceSpecialization.hasTriangles = m_Meshes.empty() ? VK_FALSE : VK_TRUE;
 }
 
 void VulkanApp::CreateUniformBuffers()
 {
-	m_pUniformBuffer = new vkw::Buffer(
-		GetDevice(), GetCommandPool(),
-		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		size_t(sizeof(UBOCompute)), nullptr
-	);
+	// A slice per frame in flight, bound with the dynamic offset of the frame the command buffer is recorded for
+	m_pUniformBuffer = new vkw::Buffer(GetDevice(), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, sizeof(UBOCompute), GetFramesInFlight());
+	// The accumulation texture is created at the surface size, the whole of it is traced until the first scaling
+	m_UniformBufferData.traceSize = glm::uvec2(GetWindow()->GetSurfaceSize().width, GetWindow()->GetSurfaceSize().height);
 }
 
 void VulkanApp::UpdateUniformBuffers()
 {
-	++m_UniformBufferData.currentLayer;
-	m_UniformBufferData.currentLayer %= m_SampleCount;
+	bool cameraMoved = m_UniformBufferData.pos != m_AccumulationCameraPos || m_UniformBufferData.forward != m_AccumulationCameraForward;
+	bool reproject = cameraMoved && m_ReprojectEnabled && !m_ResetAccumulation;
+	if (reproject)
+	{
+		// The history is kept, only the adaptive warm up restarts
+		m_UniformBufferData.previousPos = m_AccumulationCameraPos;
+		m_UniformBufferData.previousForward = m_AccumulationCameraForward;
+		m_UniformBufferData.previousRight = glm::vec4(glm::cross(glm::vec3(m_AccumulationCameraForward), glm::vec3(0.f, 1.f, 0.f)), 0.f);
+		m_UniformBufferData.previousUp = glm::vec4(glm::cross(glm::vec3(m_UniformBufferData.previousRight), glm::vec3(m_AccumulationCameraForward)), 0.f);
+		m_UniformBufferData.accumulatedFrames = 1;
+	}
+	else if (m_ResetAccumulation || cameraMoved)
+	{
+		m_UniformBufferData.accumulatedFrames = 0;
+	}
+	else
+	{
+		++m_UniformBufferData.accumulatedFrames;
+	}
+	m_AccumulationCameraPos = m_UniformBufferData.pos;
+	m_AccumulationCameraForward = m_UniformBufferData.forward;
+	m_ResetAccumulation = false;
+	// The first update comes before the compute pipeline is created, the accumulation is reset then anyway
+	if (m_pTemporalReprojection != nullptr)
+	{
+		m_pTemporalReprojection->SetEnabled(m_CurrentFrame, reproject);
+	}
+	++m_UniformBufferData.frameIndex;
 
 	m_UniformBufferData.lightDir = glm::vec3(-0.5f, -1.f, 0.5f);
 	m_UniformBufferData.lightDir = glm::normalize(m_UniformBufferData.lightDir);
@@ -212,13 +443,43 @@ void VulkanApp::UpdateUniformBuffers()
 	
 
 	m_UniformBufferData.aspectRatio =  float(GetWindow()->GetSurfaceSize().width) / float(GetWindow()->GetSurfaceSize().height);
-	m_pUniformBuffer->Update(&m_UniformBufferData , sizeof(UBOCompute), GetCommandPool());
+	m_pUniformBuffer->UpdateSlice(m_CurrentFrame, &m_UniformBufferData, sizeof(UBOCompute));
 }
 
 
-void VulkanApp::CreateSampleTextures()
+void VulkanApp::CreateAccumulationTexture()
 {
-	m_pSampleTextures = new vkw::Texture(GetDevice(), GetCommandPool(), VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_LAYOUT_GENERAL, nullptr, GetWindow()->GetSurfaceSize().width, GetWindow()->GetSurfaceSize().height, m_SampleCount);
+	// Float so the mean keeps converging past what 8 bits can resolve, texture.frag fetches it without filtering
+	m_pAccumulationTexture = new vkw::Texture(GetDevice(), GetCommandPool(), VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_LAYOUT_GENERAL, nullptr, GetWindow()->GetSurfaceSize().width, GetWindow()->GetSurfaceSize().height, 1, VK_FORMAT_R32G32B32A32_SFLOAT);
+
+	// Every frame in flight displays its own copy of the result
+	m_pDisplayImages.resize(GetFramesInFlight());
+	for (uint32_t frame = 0; frame < GetFramesInFlight(); frame++)
+	{
+		m_pDisplayImages[frame] = new vkw::Texture(GetDevice(), GetCommandPool(), VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_LAYOUT_GENERAL, nullptr, GetWindow()->GetSurfaceSize().width, GetWindow()->GetSurfaceSize().height, 1, VK_FORMAT_R32G32B32A32_SFLOAT);
+	}
+
+	// Adaptive sampling state, the sample count of every pixel is kept in w of the accumulation image
+	const uint32_t pixelCount = m_pAccumulationTexture->GetWidth() * m_pAccumulationTexture->GetHeight();
+	m_pMomentBuffer = new vkw::Buffer(
+		GetDevice(), GetCommandPool(),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		size_t(pixelCount * sizeof(float)), nullptr
+	);
+
+	const uint32_t maxTileCount = ((m_pAccumulationTexture->GetWidth() + MinTileWidth - 1) / MinTileWidth) * ((m_pAccumulationTexture->GetHeight() + MinTileHeight - 1) / MinTileHeight);
+	m_pTileListBuffer = new vkw::Buffer(
+		GetDevice(), GetCommandPool(),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		size_t(4 * sizeof(uint32_t) + maxTileCount * 2 * sizeof(uint32_t)), nullptr
+	);
+
+	// Normal, depth, id and material of the primary hits, matches Feature in raytracing_common.glsl
+	m_pFeatureBuffer = new vkw::Buffer(
+		GetDevice(), GetCommandPool(),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		size_t(pixelCount * 2 * sizeof(glm::vec4)), nullptr
+	);
 }
 
 void VulkanApp::CreateGraphicsPipeline()
@@ -251,6 +512,14 @@ void VulkanApp::CreateGraphicsPipeline()
 	pipelineLayoutCreateInfo.setLayoutCount = 1;
 	pipelineLayoutCreateInfo.pSetLayouts = &m_GraphicsDescriptorSetLayout;
 
+	// Trace size of texture.frag
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(glm::uvec2);
+	pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+	pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+
 	
 	ErrorCheck(vkCreatePipelineLayout(GetDevice()->GetDevice(), &pipelineLayoutCreateInfo, nullptr, &m_GraphicsPipelineLayout));
 
@@ -385,51 +654,60 @@ void VulkanApp::CreateGraphicsPipeline()
 
 void VulkanApp::CreateDescriptorPool()
 {
+	// A graphics and a compute set per frame in flight, the graphics set samples the display image and the compute set the cubemap
 	std::array<VkDescriptorPoolSize, 4> poolSizes{};
-	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSizes[0].descriptorCount = 1;
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	poolSizes[0].descriptorCount = GetFramesInFlight();
 	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	poolSizes[1].descriptorCount = 3;
+	poolSizes[1].descriptorCount = 2 * GetFramesInFlight();
 	poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-	poolSizes[2].descriptorCount = 1;
+	poolSizes[2].descriptorCount = GetFramesInFlight();
 	poolSizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-	poolSizes[3].descriptorCount = 1;
+	poolSizes[3].descriptorCount = 15 * GetFramesInFlight();
 
 	VkDescriptorPoolCreateInfo descriptorPoolInfo{};
 	descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	descriptorPoolInfo.poolSizeCount = poolSizes.size();
 	descriptorPoolInfo.pPoolSizes = poolSizes.data();
-	descriptorPoolInfo.maxSets = 2;
+	descriptorPoolInfo.maxSets = 2 * GetFramesInFlight();
 
 	ErrorCheck(vkCreateDescriptorPool(GetDevice()->GetDevice(), &descriptorPoolInfo, nullptr, &m_DescriptorPool));
 }
 
 void VulkanApp::CreateDescriptorSet()
 {
+	// texture.frag of every frame in flight samples the display image of that frame
+	std::vector<VkDescriptorSetLayout> setLayouts(GetFramesInFlight(), m_GraphicsDescriptorSetLayout);
+	m_GraphicsDescriptorSets.resize(GetFramesInFlight());
 	VkDescriptorSetAllocateInfo allocInfo{};
 	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	allocInfo.descriptorPool = m_DescriptorPool;
-	allocInfo.pSetLayouts = &m_GraphicsDescriptorSetLayout;
-	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = setLayouts.data();
+	allocInfo.descriptorSetCount = setLayouts.size();
 
-	ErrorCheck(vkAllocateDescriptorSets(GetDevice()->GetDevice(), &allocInfo, &m_GraphicsDescriptorSet));
-	
-	VkWriteDescriptorSet texArrayDescriptorSet{};
-	texArrayDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	texArrayDescriptorSet.dstSet = m_GraphicsDescriptorSet;
-	texArrayDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	texArrayDescriptorSet.dstBinding = 0;
-	texArrayDescriptorSet.pImageInfo = &m_pSampleTextures->GetDescriptor();
-	texArrayDescriptorSet.descriptorCount = 1;
-
-	std::vector<VkWriteDescriptorSet> writeDescriptors
-	(
-		{ texArrayDescriptorSet }
-	);
+	ErrorCheck(vkAllocateDescriptorSets(GetDevice()->GetDevice(), &allocInfo, m_GraphicsDescriptorSets.data()));
+
+	std::vector<VkDescriptorImageInfo> imageInfos(GetFramesInFlight());
+	std::vector<VkWriteDescriptorSet> writeDescriptors(GetFramesInFlight());
+	for (uint32_t frame = 0; frame < GetFramesInFlight(); frame++)
+	{
+		imageInfos[frame] = m_pDisplayImages[frame]->GetDescriptor();
+		writeDescriptors[frame].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeDescriptors[frame].dstSet = m_GraphicsDescriptorSets[frame];
+		writeDescriptors[frame].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writeDescriptors[frame].dstBinding = 0;
+		writeDescriptors[frame].pImageInfo = &imageInfos[frame];
+		writeDescriptors[frame].descriptorCount = 1;
+	}
 
 	vkUpdateDescriptorSets(GetDevice()->GetDevice(), writeDescriptors.size(), writeDescriptors.data(), 0, NULL);
 }
 
+void VulkanApp::CreateDenoiser()
+{
+	m_pDenoiser = new Denoiser(GetDevice(), GetCommandPool(), m_ComputeDescriptorSetLayout, m_pAccumulationTexture->GetWidth(), m_pAccumulationTexture->GetHeight());
+}
+
 void VulkanApp::CreateComputePipeline()
 {
 	//Create compute queue
@@ -440,13 +718,13 @@ void VulkanApp::CreateComputePipeline()
 	queueCreateInfo.queueCount = 1;
 	vkGetDeviceQueue(GetDevice()->GetDevice(), GetDevice()->GetComputeFamilyQueueId(), 0, &m_ComputeQueue);
 
-	std::array<VkDescriptorSetLayoutBinding, 6> setLayoutBindings{};
+	std::array<VkDescriptorSetLayoutBinding, 18> setLayoutBindings{};
 	setLayoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
 	setLayoutBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
 	setLayoutBindings[0].binding = 0;
 	setLayoutBindings[0].descriptorCount = 1;
 
-	setLayoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	setLayoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	setLayoutBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
 	setLayoutBindings[1].binding = 1;
 	setLayoutBindings[1].descriptorCount = 1;
@@ -471,6 +749,65 @@ void VulkanApp::CreateComputePipeline()
 	setLayoutBindings[5].binding = 5;
 	setLayoutBindings[5].descriptorCount = 1;
 
+	setLayoutBindings[6].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	setLayoutBindings[6].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	setLayoutBindings[6].binding = 6;
+	setLayoutBindings[6].descriptorCount = 1;
+
+	setLayoutBindings[7].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	setLayoutBindings[7].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	setLayoutBindings[7].binding = 7;
+	setLayoutBindings[7].descriptorCount = 1;
+
+	setLayoutBindings[8].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	setLayoutBindings[8].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	setLayoutBindings[8].binding = 8;
+	setLayoutBindings[8].descriptorCount = 1;
+
+	setLayoutBindings[9].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	setLayoutBindings[9].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	setLayoutBindings[9].binding = 9;
+	setLayoutBindings[9].descriptorCount = 1;
+
+	setLayoutBindings[10].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	setLayoutBindings[10].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	setLayoutBindings[10].binding = 10;
+	setLayoutBindings[10].descriptorCount = 1;
+
+	setLayoutBindings[11].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	setLayoutBindings[11].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	setLayoutBindings[11].binding = 11;
+	setLayoutBindings[11].descriptorCount = 1;
+
+	setLayoutBindings[12].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	setLayoutBindings[12].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	setLayoutBindings[12].binding = 12;
+	setLayoutBindings[12].descriptorCount = 1;
+
+	setLayoutBindings[13].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	setLayoutBindings[13].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	setLayoutBindings[13].binding = 13;
+	setLayoutBindings[13].descriptorCount = 1;
+
+	setLayoutBindings[14].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	setLayoutBindings[14].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	setLayoutBindings[14].binding = 14;
+	setLayoutBindings[14].descriptorCount = 1;
+
+	setLayoutBindings[15].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	setLayoutBindings[15].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	setLayoutBindings[15].binding = 15;
+	setLayoutBindings[15].descriptorCount = 1;
+
+	setLayoutBindings[16].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	setLayoutBindings[16].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	setLayoutBindings[16].binding = 16;
+	setLayoutBindings[16].descriptorCount = 1;
+
+	setLayoutBindings[17].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	setLayoutBindings[17].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	setLayoutBindings[17].binding = 17;
+	setLayoutBindings[17].descriptorCount = 1;
 
 
 	VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo{};
@@ -489,34 +826,34 @@ void VulkanApp::CreateComputePipeline()
 	
 	ErrorCheck(vkCreatePipelineLayout(GetDevice()->GetDevice(), &pipelineLayoutCreateInfo, nullptr, &m_ComputePipelineLayout));
 
+	// A set per frame in flight, so the instance buffers of one frame can be replaced while the others are traced
+	std::vector<VkDescriptorSetLayout> setLayouts(GetFramesInFlight(), m_ComputeDescriptorSetLayout);
+	m_ComputeDescriptorSets.resize(GetFramesInFlight());
 	VkDescriptorSetAllocateInfo allocInfo{};
 	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	allocInfo.descriptorPool = m_DescriptorPool;
-	allocInfo.pSetLayouts = &m_ComputeDescriptorSetLayout;
-	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = setLayouts.data();
+	allocInfo.descriptorSetCount = setLayouts.size();
 
 	
-	ErrorCheck(vkAllocateDescriptorSets(GetDevice()->GetDevice(), &allocInfo, &m_ComputeDescriptorSet));
+	ErrorCheck(vkAllocateDescriptorSets(GetDevice()->GetDevice(), &allocInfo, m_ComputeDescriptorSets.data()));
 
-	std::array<VkWriteDescriptorSet, 6> computeWriteDescriptorSets{};
+	std::array<VkWriteDescriptorSet, 16> computeWriteDescriptorSets{};
 	computeWriteDescriptorSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 	computeWriteDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
 	computeWriteDescriptorSets[0].descriptorCount = 1;
-	computeWriteDescriptorSets[0].dstSet = m_ComputeDescriptorSet;
 	computeWriteDescriptorSets[0].dstBinding = 0;
-	computeWriteDescriptorSets[0].pImageInfo = &m_pSampleTextures->GetDescriptor();
+	computeWriteDescriptorSets[0].pImageInfo = &m_pAccumulationTexture->GetDescriptor();
 
 	computeWriteDescriptorSets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	computeWriteDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	computeWriteDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	computeWriteDescriptorSets[1].descriptorCount = 1;
-	computeWriteDescriptorSets[1].dstSet = m_ComputeDescriptorSet;
 	computeWriteDescriptorSets[1].dstBinding = 1;
 	computeWriteDescriptorSets[1].pBufferInfo = &m_pUniformBuffer->GetDescriptor();
 
 	computeWriteDescriptorSets[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 	computeWriteDescriptorSets[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 	computeWriteDescriptorSets[2].descriptorCount = 1;
-	computeWriteDescriptorSets[2].dstSet = m_ComputeDescriptorSet;
 	computeWriteDescriptorSets[2].dstBinding = 2;
 	computeWriteDescriptorSets[2].pBufferInfo = &m_pSphereGeomBuffer->GetDescriptor();
 
@@ -524,33 +861,165 @@ void VulkanApp::CreateComputePipeline()
 	computeWriteDescriptorSets[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 	computeWriteDescriptorSets[3].descriptorCount = 1;
 	computeWriteDescriptorSets[3].dstBinding = 3;
-	computeWriteDescriptorSets[3].dstSet = m_ComputeDescriptorSet;
 	computeWriteDescriptorSets[3].pBufferInfo = &m_pPlaneGeomBuffer->GetDescriptor();
 
 	computeWriteDescriptorSets[4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 	computeWriteDescriptorSets[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 	computeWriteDescriptorSets[4].descriptorCount = 1;
 	computeWriteDescriptorSets[4].dstBinding = 4;
-	computeWriteDescriptorSets[4].dstSet = m_ComputeDescriptorSet;
 	computeWriteDescriptorSets[4].pBufferInfo = &m_pTriangleGeomBuffer->GetDescriptor();
 
 	computeWriteDescriptorSets[5].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 	computeWriteDescriptorSets[5].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	computeWriteDescriptorSets[5].descriptorCount = 1;
 	computeWriteDescriptorSets[5].dstBinding = 5;
-	computeWriteDescriptorSets[5].dstSet = m_ComputeDescriptorSet;
 	computeWriteDescriptorSets[5].pImageInfo = &m_CubeMap.descriptor;
 
+	computeWriteDescriptorSets[6].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	computeWriteDescriptorSets[6].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	computeWriteDescriptorSets[6].descriptorCount = 1;
+	computeWriteDescriptorSets[6].dstBinding = 6;
+	computeWriteDescriptorSets[6].pBufferInfo = &m_pTriangleBVHBuffer->GetDescriptor();
+
+	computeWriteDescriptorSets[7].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	computeWriteDescriptorSets[7].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	computeWriteDescriptorSets[7].descriptorCount = 1;
+	computeWriteDescriptorSets[7].dstBinding = 7;
+	computeWriteDescriptorSets[7].pBufferInfo = &m_pSphereBVHBuffer->GetDescriptor();
+
+	computeWriteDescriptorSets[8].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	computeWriteDescriptorSets[8].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	computeWriteDescriptorSets[8].descriptorCount = 1;
+	computeWriteDescriptorSets[8].dstBinding = 10;
+	computeWriteDescriptorSets[8].pBufferInfo = &m_pTriangleWideBVHBuffer->GetDescriptor();
+
+	computeWriteDescriptorSets[9].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	computeWriteDescriptorSets[9].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	computeWriteDescriptorSets[9].descriptorCount = 1;
+	computeWriteDescriptorSets[9].dstBinding = 11;
+	computeWriteDescriptorSets[9].pBufferInfo = &m_pSphereWideBVHBuffer->GetDescriptor();
+
+	computeWriteDescriptorSets[10].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	computeWriteDescriptorSets[10].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	computeWriteDescriptorSets[10].descriptorCount = 1;
+	computeWriteDescriptorSets[10].dstBinding = 12;
+	computeWriteDescriptorSets[10].pBufferInfo = &m_pVertexBuffer->GetDescriptor();
+
+	computeWriteDescriptorSets[11].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	computeWriteDescriptorSets[11].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	computeWriteDescriptorSets[11].descriptorCount = 1;
+	computeWriteDescriptorSets[11].dstBinding = 13;
+	computeWriteDescriptorSets[11].pBufferInfo = &m_pMaterialBuffer->GetDescriptor();
+
+	computeWriteDescriptorSets[12].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	computeWriteDescriptorSets[12].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	computeWriteDescriptorSets[12].descriptorCount = 1;
+	computeWriteDescriptorSets[12].dstBinding = 14;
+	computeWriteDescriptorSets[12].pBufferInfo = &m_pWorkCounterBuffer->GetDescriptor();
+
+	computeWriteDescriptorSets[13].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	computeWriteDescriptorSets[13].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	computeWriteDescriptorSets[13].descriptorCount = 1;
+	computeWriteDescriptorSets[13].dstBinding = 15;
+	computeWriteDescriptorSets[13].pBufferInfo = &m_pMomentBuffer->GetDescriptor();
+
+	computeWriteDescriptorSets[14].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	computeWriteDescriptorSets[14].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	computeWriteDescriptorSets[14].descriptorCount = 1;
+	computeWriteDescriptorSets[14].dstBinding = 16;
+	computeWriteDescriptorSets[14].pBufferInfo = &m_pTileListBuffer->GetDescriptor();
+
+	computeWriteDescriptorSets[15].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	computeWriteDescriptorSets[15].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	computeWriteDescriptorSets[15].descriptorCount = 1;
+	computeWriteDescriptorSets[15].dstBinding = 17;
+	computeWriteDescriptorSets[15].pBufferInfo = &m_pFeatureBuffer->GetDescriptor();
+
+
+	for (uint32_t frame = 0; frame < m_ComputeDescriptorSets.size(); frame++)
+	{
+		for (VkWriteDescriptorSet& writeDescriptorSet : computeWriteDescriptorSets)
+		{
+			writeDescriptorSet.dstSet = m_ComputeDescriptorSets[frame];
+		}
+		vkUpdateDescriptorSets(GetDevice()->GetDevice(), computeWriteDescriptorSets.size(), computeWriteDescriptorSets.data(), 0, NULL);
+		WriteInstanceDescriptors(frame);
+	}
+
+	if (!m_Autotune)
+	{
+		LoadTuning();
+	}
+	CreateTracePipelines();
+
+	// The wavefront and reprojection passes share the scene constants, their local size is fixed so the workgroup size entries are ignored
+	VkSpecializationInfo specializationInfo = GetTraceSpecializationInfo();
+	m_pWavefrontTracer = new WavefrontTracer(GetDevice(), GetCommandPool(), m_ComputeDescriptorSetLayout, &specializationInfo, m_pAccumulationTexture->GetWidth(), m_pAccumulationTexture->GetHeight(), GetFramesInFlight());
+	m_pTemporalReprojection = new TemporalReprojection(GetDevice(), GetCommandPool(), m_ComputeDescriptorSetLayout, &specializationInfo, m_pAccumulationTexture->GetWidth(), m_pAccumulationTexture->GetHeight(), GetFramesInFlight());
+
+	// Separate command pool as queue family for compute may be different than graphics
+	VkCommandPoolCreateInfo cmdPoolInfo = {};
+	cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	cmdPoolInfo.queueFamilyIndex = GetDevice()->GetComputeFamilyQueueId();
+	cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	
+	ErrorCheck(vkCreateCommandPool(GetDevice()->GetDevice(), &cmdPoolInfo, nullptr, &m_ComputeCommandPool));
+
+	// A command buffer for compute operations per frame in flight, the compute timeline chains the trace to the composite
+	m_ComputeCommandBuffers.resize(GetFramesInFlight());
+	m_FrameComputeValues.resize(GetFramesInFlight(), 0);
+	m_ComputeCommandBufferDirty.resize(GetFramesInFlight(), false);
+	m_InstanceDescriptorsDirty.resize(GetFramesInFlight(), false);
+	m_FrameGraphicsValues.resize(GetFramesInFlight(), 0);
+
+	VkCommandBufferAllocateInfo commandBufferAllocateInfo{};
+	commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	commandBufferAllocateInfo.commandPool = m_ComputeCommandPool;
+	commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	commandBufferAllocateInfo.commandBufferCount = m_ComputeCommandBuffers.size();
+
+	ErrorCheck(vkAllocateCommandBuffers(GetDevice()->GetDevice(), &commandBufferAllocateInfo, m_ComputeCommandBuffers.data()));
 
-	vkUpdateDescriptorSets(GetDevice()->GetDevice(), computeWriteDescriptorSets.size(), computeWriteDescriptorSets.data(), 0, NULL);
+	m_SphereBuildCommandBuffers.resize(GetFramesInFlight());
+	ErrorCheck(vkAllocateCommandBuffers(GetDevice()->GetDevice(), &commandBufferAllocateInfo, m_SphereBuildCommandBuffers.data()));
 
+	m_pComputeTimeline = new vkw::QueueTimeline(GetDevice(), m_ComputeQueue);
+	m_pStagingRing = new vkw::StagingRing(GetDevice(), m_pComputeTimeline, GetDevice()->GetComputeFamilyQueueId(), StagingRingSize);
+}
+
+VkSpecializationInfo VulkanApp::GetTraceSpecializationInfo() const
+{
+	// Constant ids follow the order of the TraceSpecialization members
+	static const VkSpecializationMapEntry entries[] = {
+		{ 0, offsetof(TraceSpecialization, maxDepth), sizeof(uint32_t) },
+		{ 1, offsetof(TraceSpecialization, epsilon), sizeof(float) },
+		{ 2, offsetof(TraceSpecialization, maxLength), sizeof(float) },
+		{ 3, offsetof(TraceSpecialization, hasSpheres), sizeof(VkBool32) },
+		{ 4, offsetof(TraceSpecialization, hasPlanes), sizeof(VkBool32) },
+		{ 5, offsetof(TraceSpecialization, hasTriangles), sizeof(VkBool32) },
+		{ 6, offsetof(TraceSpecialization, workGroupSizeX), sizeof(uint32_t) },
+		{ 7, offsetof(TraceSpecialization, workGroupSizeY), sizeof(uint32_t) }
+	};
+
+	VkSpecializationInfo specializationInfo{};
+	specializationInfo.mapEntryCount = sizeof(entries) / sizeof(entries[0]);
+	specializationInfo.pMapEntries = entries;
+	specializationInfo.dataSize = sizeof(TraceSpecialization);
+	specializationInfo.pData = &m_TraceSpecialization;
+	return specializationInfo;
+}
+
+void VulkanApp::CreateTracePipelines()
+{
 	VkShaderModule computeShaderModule = CreateShaderModule(readFile("Shaders/raytracing.comp.spv"), GetDevice()->GetDevice());
+	VkSpecializationInfo specializationInfo = GetTraceSpecializationInfo();
 
 	VkPipelineShaderStageCreateInfo computeShaderStageInfo{};
 	computeShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	computeShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
 	computeShaderStageInfo.module = computeShaderModule;
 	computeShaderStageInfo.pName = "main";
+	computeShaderStageInfo.pSpecializationInfo = &specializationInfo;
 
 	VkComputePipelineCreateInfo computePipelineCreateInfo{};
 	computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
@@ -562,56 +1031,652 @@ void VulkanApp::CreateComputePipeline()
 
 	vkDestroyShaderModule(GetDevice()->GetDevice(), computeShaderModule, nullptr);
 
-	// Separate command pool as queue family for compute may be different than graphics
-	VkCommandPoolCreateInfo cmdPoolInfo = {};
-	cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	cmdPoolInfo.queueFamilyIndex = GetDevice()->GetComputeFamilyQueueId();
-	cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-	
-	ErrorCheck(vkCreateCommandPool(GetDevice()->GetDevice(), &cmdPoolInfo, nullptr, &m_ComputeCommandPool));
+	VkShaderModule persistentShaderModule = CreateShaderModule(readFile("Shaders/raytracing_persistent.comp.spv"), GetDevice()->GetDevice());
+	computePipelineCreateInfo.stage.module = persistentShaderModule;
+
+	ErrorCheck(vkCreateComputePipelines(GetDevice()->GetDevice(), VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &m_PersistentComputePipeline));
+
+	vkDestroyShaderModule(GetDevice()->GetDevice(), persistentShaderModule, nullptr);
+
+	// The tile list is allocated for the smallest tiles, every candidate of the autotuner is at least this size
+	assert(m_TraceSpecialization.workGroupSizeX >= MinTileWidth && m_TraceSpecialization.workGroupSizeY >= MinTileHeight && "Tiles smaller than the tile list was allocated for!");
+
+	VkShaderModule adaptiveShaderModule = CreateShaderModule(readFile("Shaders/raytracing_adaptive.comp.spv"), GetDevice()->GetDevice());
+	computePipelineCreateInfo.stage.module = adaptiveShaderModule;
+
+	ErrorCheck(vkCreateComputePipelines(GetDevice()->GetDevice(), VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &m_AdaptiveComputePipeline));
+
+	vkDestroyShaderModule(GetDevice()->GetDevice(), adaptiveShaderModule, nullptr);
+
+	VkShaderModule scheduleShaderModule = CreateShaderModule(readFile("Shaders/adaptive_schedule.comp.spv"), GetDevice()->GetDevice());
+	computePipelineCreateInfo.stage.module = scheduleShaderModule;
+
+	ErrorCheck(vkCreateComputePipelines(GetDevice()->GetDevice(), VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &m_TileSchedulePipeline));
+
+	vkDestroyShaderModule(GetDevice()->GetDevice(), scheduleShaderModule, nullptr);
+}
 
-	// Create a command buffer for compute operations
+void VulkanApp::DestroyTracePipelines()
+{
+	vkDestroyPipeline(GetDevice()->GetDevice(), m_ComputePipeline, nullptr);
+	vkDestroyPipeline(GetDevice()->GetDevice(), m_PersistentComputePipeline, nullptr);
+	vkDestroyPipeline(GetDevice()->GetDevice(), m_AdaptiveComputePipeline, nullptr);
+	vkDestroyPipeline(GetDevice()->GetDevice(), m_TileSchedulePipeline, nullptr);
+	m_ComputePipeline = VK_NULL_HANDLE;
+	m_PersistentComputePipeline = VK_NULL_HANDLE;
+	m_AdaptiveComputePipeline = VK_NULL_HANDLE;
+	m_TileSchedulePipeline = VK_NULL_HANDLE;
+}
+
+void VulkanApp::RecordTraceDispatch(VkCommandBuffer commandBuffer, TraceMode mode, uint32_t frame)
+{
+	const uint32_t uniformOffset = m_pUniformBuffer->GetSliceOffset(frame);
+	if (mode == PersistentTraceMode)
+	{
+		// The previous frame has to be done with the counter before it is reset
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+		vkCmdFillBuffer(commandBuffer, m_pWorkCounterBuffer->GetDescriptor().buffer, 0, VK_WHOLE_SIZE, 0);
+		VkMemoryBarrier fillBarrier{};
+		fillBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		fillBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		fillBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &fillBarrier, 0, nullptr, 0, nullptr);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_PersistentComputePipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_ComputePipelineLayout, 0, 1, &m_ComputeDescriptorSets[frame], 1, &uniformOffset);
+
+		vkCmdDispatch(commandBuffer, m_PersistentGroupCount, 1, 1);
+	}
+	else if (mode == AdaptiveTraceMode)
+	{
+		const uint32_t groupSizeX = m_TraceSpecialization.workGroupSizeX;
+		const uint32_t groupSizeY = m_TraceSpecialization.workGroupSizeY;
+		const glm::uvec2 traceSize = m_UniformBufferData.traceSize;
+		VkBuffer tileListBuffer = m_pTileListBuffer->GetDescriptor().buffer;
+
+		// Empty the tile list, the previous frame has to be done with it first
+		const VkDispatchIndirectCommand emptyDispatch{ 0, 1, 1 };
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+		vkCmdUpdateBuffer(commandBuffer, tileListBuffer, 0, sizeof(VkDispatchIndirectCommand), &emptyDispatch);
+		VkMemoryBarrier clearBarrier{};
+		clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+		// One group per tile appends the tiles that still need samples
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_TileSchedulePipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_ComputePipelineLayout, 0, 1, &m_ComputeDescriptorSets[frame], 1, &uniformOffset);
+		vkCmdDispatch(commandBuffer, (traceSize.x + groupSizeX - 1) / groupSizeX, (traceSize.y + groupSizeY - 1) / groupSizeY, 1);
+
+		VkMemoryBarrier scheduleBarrier{};
+		scheduleBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		scheduleBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		scheduleBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &scheduleBarrier, 0, nullptr, 0, nullptr);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_AdaptiveComputePipeline);
+		vkCmdDispatchIndirect(commandBuffer, tileListBuffer, 0);
+	}
+	else
+	{
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_ComputePipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_ComputePipelineLayout, 0, 1, &m_ComputeDescriptorSets[frame], 1, &uniformOffset);
+
+		const uint32_t groupSizeX = m_TraceSpecialization.workGroupSizeX;
+		const uint32_t groupSizeY = m_TraceSpecialization.workGroupSizeY;
+		const glm::uvec2 traceSize = m_UniformBufferData.traceSize;
+		vkCmdDispatch(commandBuffer, (traceSize.x + groupSizeX - 1) / groupSizeX, (traceSize.y + groupSizeY - 1) / groupSizeY, 1);
+	}
+}
+
+void VulkanApp::BuildComputeCommandBuffers()
+{
+	for (uint32_t frame = 0; frame < m_ComputeCommandBuffers.size(); frame++)
+	{
+		RecordComputeCommandBuffer(frame);
+	}
+}
+
+void VulkanApp::RecordComputeCommandBuffer(uint32_t frame)
+{
+	VkCommandBuffer commandBuffer = m_ComputeCommandBuffers[frame];
+	VkCommandBufferBeginInfo commandBufferBeginInfo{};
+	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+	ErrorCheck(vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo));
+
+	// The trace of the previous frame may still be running, it has to be done with the images and buffers this one writes
+	VkMemoryBarrier frameBarrier{};
+	frameBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	frameBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	frameBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &frameBarrier, 0, nullptr, 0, nullptr);
+
+	const uint32_t uniformOffset = m_pUniformBuffer->GetSliceOffset(frame);
+	vkw::TimestampQuery* pTimestampQuery = m_TimestampQueries[frame];
+	pTimestampQuery->Reset(commandBuffer);
+	pTimestampQuery->Write(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, ComputeBeginTimestamp);
+	pTimestampQuery->Write(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, TraceBeginTimestamp);
+
+	// Empty dispatches unless the camera moved, its time counts towards the trace
+	m_pTemporalReprojection->RecordReprojection(commandBuffer, m_ComputeDescriptorSets[frame], uniformOffset, frame);
+	if (m_TraceMode == WavefrontTraceMode)
+	{
+		m_pWavefrontTracer->RecordTrace(commandBuffer, m_ComputeDescriptorSets[frame], uniformOffset, m_TraceSpecialization.maxDepth, frame);
+	}
+	else
+	{
+		RecordTraceDispatch(commandBuffer, m_TraceMode, frame);
+	}
+	pTimestampQuery->Write(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, TraceEndTimestamp);
+
+	if (m_DenoiseEnabled)
+	{
+		m_pDenoiser->RecordDenoise(commandBuffer, m_ComputeDescriptorSets[frame], uniformOffset);
+	}
+	pTimestampQuery->Write(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, DenoiseEndTimestamp);
+
+	// The next trace writes the accumulation again while this frame is composited, so the composite samples a copy of its own
+	vkw::Texture* pResult = m_DenoiseEnabled ? m_pDenoiser->GetOutput() : m_pAccumulationTexture;
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	VkImageCopy copyRegion{};
+	copyRegion.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+	copyRegion.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+	// The composite only samples the traced rectangle
+	copyRegion.extent = { m_UniformBufferData.traceSize.x, m_UniformBufferData.traceSize.y, 1 };
+	vkCmdCopyImage(commandBuffer, pResult->GetImage(), VK_IMAGE_LAYOUT_GENERAL, m_pDisplayImages[frame]->GetImage(), VK_IMAGE_LAYOUT_GENERAL, 1, &copyRegion);
+
+	// The next trace may only overwrite the result once the copy read it
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	ErrorCheck(vkEndCommandBuffer(commandBuffer));
+}
+
+void VulkanApp::ReportTraceTimings(uint32_t frame)
+{
+	// Called once the compute timeline passed the last submit of the frame, so its timestamps are available
+	const TraceSubmit& submit = m_TraceSubmits[frame];
+	vkw::TimestampQuery* pTimestampQuery = m_TimestampQueries[frame];
+	if (!submit.submitted || !pTimestampQuery->FetchResults())
+		return;
+
+	uint32_t layout = ((submit.traceFlags & WideTriangleBVH) ? 1 : 0) + 2 * submit.mode;
+	m_TraceTime[layout] += pTimestampQuery->GetMilliseconds(TraceBeginTimestamp, TraceEndTimestamp);
+	if (submit.mode == WavefrontTraceMode)
+		m_TracedRays[layout] += m_pWavefrontTracer->GetTracedRayCount(frame);
+	m_TracedPixels[layout] += submit.tracePixels;
+	m_TracedFrames[layout]++;
+	UpdateResolutionScale(pTimestampQuery->GetMilliseconds(ComputeBeginTimestamp, DenoiseEndTimestamp));
+	if (submit.denoise)
+	{
+		m_DenoiseTime += pTimestampQuery->GetMilliseconds(TraceEndTimestamp, DenoiseEndTimestamp);
+		m_DenoisedFrames++;
+	}
+	if (m_TracedFrames[layout] % 100 != 0)
+		return;
+
+	if (m_DenoisedFrames > 0)
+		std::cout << "Denoiser (" << Denoiser::IterationCount << " iterations): " << m_DenoiseTime / m_DenoisedFrames << " ms (" << m_DenoisedFrames << " frames)" << std::endl;
+
+	if (m_DynamicResolution)
+		std::cout << "Trace resolution: " << m_UniformBufferData.traceSize.x << "x" << m_UniformBufferData.traceSize.y << ", compute frame: " << m_AverageComputeTime << " ms (target " << m_TargetFrameTime << " ms)" << std::endl;
+
+	const char* layoutNames[2 * TraceModeCount]{ "megakernel, binary", "megakernel, wide", "persistent threads, binary", "persistent threads, wide", "wavefront, binary", "wavefront, wide", "adaptive, binary", "adaptive, wide" };
+	for (uint32_t i = 0; i < 2 * TraceModeCount; i++)
+	{
+		if (m_TracedFrames[i] == 0)
+			continue;
+		float traceTime = m_TraceTime[i] / m_TracedFrames[i];
+		std::cout << "Raytracing (" << layoutNames[i] << " bvh): " << traceTime << " ms";
+		// Adaptive sampling skips converged tiles, so it does not trace a sample for every pixel
+		if (i / 2 != AdaptiveTraceMode)
+			std::cout << ", " << m_TracedPixels[i] / (m_TraceTime[i] * 1000.0) << " Msamples/s";
+		if (m_TracedRays[i] > 0.0)
+			std::cout << ", " << m_TracedRays[i] / (m_TraceTime[i] * 1000.0) << " Mrays/s";
+		std::cout << " (" << m_TracedFrames[i] << " frames)" << std::endl;
+	}
+}
+
+void VulkanApp::UpdateResolutionScale(float computeMilliseconds)
+{
+	m_AverageComputeTime = (m_FramesSinceResolutionChange == 0) ? computeMilliseconds : glm::mix(m_AverageComputeTime, computeMilliseconds, 0.1f);
+	++m_FramesSinceResolutionChange;
+	if (!m_DynamicResolution || m_FramesSinceResolutionChange < ResolutionSettleFrames)
+		return;
+
+	if (m_AverageComputeTime > m_TargetFrameTime * 1.05f || m_AverageComputeTime < m_TargetFrameTime * 0.8f)
+	{
+		// The cost grows with the traced pixels, so with the square of the scale
+		SetResolutionScale(m_ResolutionScale * std::sqrt(m_TargetFrameTime / std::max(m_AverageComputeTime, 0.01f)));
+	}
+}
+
+void VulkanApp::SetResolutionScale(float scale)
+{
+	scale = glm::clamp(scale, MinResolutionScale, 1.f);
+	const glm::uvec2 maxSize{ m_pAccumulationTexture->GetWidth(), m_pAccumulationTexture->GetHeight() };
+	glm::uvec2 traceSize = glm::uvec2(glm::vec2(maxSize) * scale) + TraceSizeGranularity - 1u;
+	traceSize = glm::min(traceSize - traceSize % TraceSizeGranularity, maxSize);
+	// Kept even when the rectangle does not change, so small steps add up instead of being rounded away every time
+	m_ResolutionScale = scale;
+	if (traceSize == m_UniformBufferData.traceSize)
+		return;
+
+	m_UniformBufferData.traceSize = traceSize;
+	m_ResetAccumulation = true;
+	m_FramesSinceResolutionChange = 0;
+
+	// The dispatches are sized to the traced rectangle, so each command buffer is recorded again before its next submit
+	m_pWavefrontTracer->SetTraceSize(traceSize.x, traceSize.y);
+	m_pTemporalReprojection->SetTraceSize(traceSize.x, traceSize.y);
+	m_pDenoiser->SetTraceSize(traceSize.x, traceSize.y);
+	m_ComputeCommandBufferDirty.assign(m_ComputeCommandBufferDirty.size(), true);
+}
+
+void VulkanApp::SetAutotune(bool autotune)
+{
+	m_Autotune = autotune;
+}
+
+void VulkanApp::SetTargetFrameTime(float milliseconds)
+{
+	m_TargetFrameTime = milliseconds;
+}
+
+void VulkanApp::SetFramesInFlight(uint32_t frameCount)
+{
+	VulkanBaseApp::SetFramesInFlight(frameCount);
+}
+
+void VulkanApp::Autotune()
+{
+	if (!m_TimestampQueries[0]->IsSupported())
+	{
+		std::cout << "Autotune: timestamps are not supported, keeping the default configuration" << std::endl;
+		return;
+	}
+	const VkPhysicalDeviceLimits& limits = GetDevice()->GetPhysicalDeviceProperties().limits;
+
+	// Local sizes are tuned on the megakernel, the persistent group count with the chosen local size
+	const std::array<glm::uvec2, 8> localSizes{ glm::uvec2(8, 4), glm::uvec2(8, 8), glm::uvec2(16, 4), glm::uvec2(16, 8), glm::uvec2(16, 16), glm::uvec2(32, 4), glm::uvec2(32, 8), glm::uvec2(32, 16) };
+	glm::uvec2 bestLocalSize{ m_TraceSpecialization.workGroupSizeX, m_TraceSpecialization.workGroupSizeY };
+	float bestTime = std::numeric_limits<float>::max();
+	for (const glm::uvec2& localSize : localSizes)
+	{
+		if (localSize.x * localSize.y > limits.maxComputeWorkGroupInvocations || localSize.x > limits.maxComputeWorkGroupSize[0] || localSize.y > limits.maxComputeWorkGroupSize[1])
+			continue;
+
+		m_TraceSpecialization.workGroupSizeX = localSize.x;
+		m_TraceSpecialization.workGroupSizeY = localSize.y;
+		DestroyTracePipelines();
+		CreateTracePipelines();
+		float time = BenchmarkTraceDispatch(MegakernelTraceMode);
+		std::cout << "Autotune: local size " << localSize.x << "x" << localSize.y << ": " << time << " ms" << std::endl;
+		if (time < bestTime)
+		{
+			bestTime = time;
+			bestLocalSize = localSize;
+		}
+	}
+	m_TraceSpecialization.workGroupSizeX = bestLocalSize.x;
+	m_TraceSpecialization.workGroupSizeY = bestLocalSize.y;
+	DestroyTracePipelines();
+	CreateTracePipelines();
+
+	const std::array<uint32_t, 7> groupCounts{ 64, 128, 256, 512, 1024, 2048, 4096 };
+	uint32_t bestGroupCount = m_PersistentGroupCount;
+	bestTime = std::numeric_limits<float>::max();
+	for (uint32_t groupCount : groupCounts)
+	{
+		if (groupCount > limits.maxComputeWorkGroupCount[0])
+			continue;
+
+		m_PersistentGroupCount = groupCount;
+		float time = BenchmarkTraceDispatch(PersistentTraceMode);
+		std::cout << "Autotune: " << groupCount << " persistent groups: " << time << " ms" << std::endl;
+		if (time < bestTime)
+		{
+			bestTime = time;
+			bestGroupCount = groupCount;
+		}
+	}
+	m_PersistentGroupCount = bestGroupCount;
+
+	std::cout << "Autotune: local size " << bestLocalSize.x << "x" << bestLocalSize.y << ", " << bestGroupCount << " persistent groups" << std::endl;
+	SaveTuning();
+}
+
+float VulkanApp::BenchmarkTraceDispatch(TraceMode mode)
+{
 	VkCommandBufferAllocateInfo commandBufferAllocateInfo{};
 	commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 	commandBufferAllocateInfo.commandPool = m_ComputeCommandPool;
 	commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
 	commandBufferAllocateInfo.commandBufferCount = 1;
 
-	ErrorCheck(vkAllocateCommandBuffers(GetDevice()->GetDevice(), &commandBufferAllocateInfo, &m_ComputeCommandBuffer));
+	VkCommandBuffer commandBuffer;
+	ErrorCheck(vkAllocateCommandBuffers(GetDevice()->GetDevice(), &commandBufferAllocateInfo, &commandBuffer));
 
-	// Fence for compute CB sync
-	VkFenceCreateInfo fenceCreateInfo{};
-	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-	
-	ErrorCheck(vkCreateFence(GetDevice()->GetDevice(), &fenceCreateInfo, nullptr, &m_ComputeFence));
+	// The sphere bvh has to be built before it can be traced, the queue runs the build before the benchmark
+	if (m_SphereBVHBuildPending)
+	{
+		SubmitSphereBVHBuild(m_CurrentFrame);
+	}
+	// Nothing else is submitted yet, the benchmark uses the timestamps and uniform slice of the first frame
+	vkw::TimestampQuery* pTimestampQuery = m_TimestampQueries[m_CurrentFrame];
+
+	// The first run only warms up, the fastest of the others is kept
+	const uint32_t runCount{ 5 };
+	float bestTime = std::numeric_limits<float>::max();
+	for (uint32_t run = 0; run <= runCount; run++)
+	{
+		VkCommandBufferBeginInfo commandBufferBeginInfo{};
+		commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		ErrorCheck(vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo));
+		pTimestampQuery->Reset(commandBuffer);
+		pTimestampQuery->Write(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, ComputeBeginTimestamp);
+		pTimestampQuery->Write(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, TraceBeginTimestamp);
+		RecordTraceDispatch(commandBuffer, mode, m_CurrentFrame);
+		pTimestampQuery->Write(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, TraceEndTimestamp);
+		// Every timestamp has to be written before the results can be fetched
+		pTimestampQuery->Write(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, DenoiseEndTimestamp);
+		ErrorCheck(vkEndCommandBuffer(commandBuffer));
+
+		m_pComputeTimeline->Wait(m_pComputeTimeline->Submit(commandBuffer));
+
+		if (run > 0 && pTimestampQuery->FetchResults())
+			bestTime = std::min(bestTime, pTimestampQuery->GetMilliseconds(TraceBeginTimestamp, TraceEndTimestamp));
+	}
 
+	vkFreeCommandBuffers(GetDevice()->GetDevice(), m_ComputeCommandPool, 1, &commandBuffer);
+	return bestTime;
 }
 
-void VulkanApp::BuildComputeCommandBuffers()
+void VulkanApp::LoadTuning()
 {
-	VkCommandBufferBeginInfo commandBufferBeginInfo{};
-	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	const VkPhysicalDeviceProperties& properties = GetDevice()->GetPhysicalDeviceProperties();
+	std::ifstream file(TuningCachePath);
+	std::string line;
+	while (std::getline(file, line))
+	{
+		std::istringstream stream(line);
+		uint32_t vendorId, deviceId, driverVersion, workGroupSizeX, workGroupSizeY, persistentGroupCount;
+		if (!(stream >> vendorId >> deviceId >> driverVersion >> workGroupSizeX >> workGroupSizeY >> persistentGroupCount))
+			continue;
+		if (vendorId != properties.vendorID || deviceId != properties.deviceID || driverVersion != properties.driverVersion)
+			continue;
+
+		// The cache is a plain text file, an entry the device cannot run or smaller than the tiles the tile list is allocated for keeps the defaults
+		const VkPhysicalDeviceLimits& limits = properties.limits;
+		if (workGroupSizeX < MinTileWidth || workGroupSizeY < MinTileHeight
+			|| workGroupSizeX * workGroupSizeY > limits.maxComputeWorkGroupInvocations
+			|| workGroupSizeX > limits.maxComputeWorkGroupSize[0] || workGroupSizeY > limits.maxComputeWorkGroupSize[1]
+			|| persistentGroupCount == 0 || persistentGroupCount > limits.maxComputeWorkGroupCount[0])
+		{
+			std::cout << "Invalid tuned configuration in " << TuningCachePath << ", keeping the default configuration" << std::endl;
+			return;
+		}
 
-	ErrorCheck(vkBeginCommandBuffer(m_ComputeCommandBuffer, &commandBufferBeginInfo));
+		m_TraceSpecialization.workGroupSizeX = workGroupSizeX;
+		m_TraceSpecialization.workGroupSizeY = workGroupSizeY;
+		m_PersistentGroupCount = persistentGroupCount;
+		std::cout << "Tuned configuration: local size " << workGroupSizeX << "x" << workGroupSizeY << ", " << persistentGroupCount << " persistent groups" << std::endl;
+		return;
+	}
+}
 
-	vkCmdBindPipeline(m_ComputeCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_ComputePipeline);
-	vkCmdBindDescriptorSets(m_ComputeCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_ComputePipelineLayout, 0, 1, &m_ComputeDescriptorSet, 0, 0);
+void VulkanApp::SaveTuning()
+{
+	const VkPhysicalDeviceProperties& properties = GetDevice()->GetPhysicalDeviceProperties();
+	std::ostringstream key;
+	key << properties.vendorID << " " << properties.deviceID << " " << properties.driverVersion << " ";
 
-	vkCmdDispatch(m_ComputeCommandBuffer, m_pSampleTextures->GetWidth() / 16, m_pSampleTextures->GetHeight() / 16, 1);
+	// Entries of other devices are kept, the one of this device is replaced
+	std::vector<std::string> lines;
+	{
+		std::ifstream file(TuningCachePath);
+		std::string line;
+		while (std::getline(file, line))
+		{
+			if (!line.empty() && line.compare(0, key.str().size(), key.str()) != 0)
+				lines.push_back(line);
+		}
+	}
+	std::ostringstream entry;
+	entry << key.str() << m_TraceSpecialization.workGroupSizeX << " " << m_TraceSpecialization.workGroupSizeY << " " << m_PersistentGroupCount;
+	lines.push_back(entry.str());
 
-	vkEndCommandBuffer(m_ComputeCommandBuffer);
+	std::ofstream file(TuningCachePath, std::ios::trunc);
+	if (!file)
+	{
+		std::cout << "Autotune: could not write " << TuningCachePath << std::endl;
+		return;
+	}
+	for (const std::string& line : lines)
+	{
+		file << line << "\n";
+	}
 }
 
 void VulkanApp::UpdateSpheres()
 {
+	std::vector<AABB> sphereBounds(m_Spheres.size());
 	for (size_t i = 0; i < m_Spheres.size(); i++)
 	{
-		m_Spheres[i].pos.y = sin((m_AccuTime/5.f)+i);
+		// Phase is based on the id as the bvh reorders the spheres
+		m_Spheres[i].pos.y = sin((m_AccuTime/5.f) + (m_Spheres[i].id - 1));
+		sphereBounds[i].Grow(m_Spheres[i].pos - glm::vec3(m_Spheres[i].radius));
+		sphereBounds[i].Grow(m_Spheres[i].pos + glm::vec3(m_Spheres[i].radius));
+	}
+
+	// The gpu builder rebuilds the bvh from the uploaded spheres before the next trace
+	if (m_pSphereLBVHBuilder != nullptr)
+	{
+		m_SphereBVHBuildPending = true;
+	}
+	else
+	{
+		m_SphereBVH.Refit(sphereBounds);
+		if (m_SphereBVH.GetSAHCost() > m_SphereBVHBuildCost * m_SphereBVHRebuildThreshold)
+		{
+			BuildSphereBVH();
+		}
+		else
+		{
+			m_SphereWideBVH.Build(m_SphereBVH.GetNodes());
+		}
+		m_pSphereBVHBuffer->Update(m_SphereBVH.GetNodes().data(), m_SphereBVH.GetNodes().size() * sizeof(BVHNode), m_pStagingRing);
+		m_pSphereWideBVHBuffer->Update(m_SphereWideBVH.GetNodes().data(), m_SphereWideBVH.GetNodes().size() * sizeof(WideBVHNode), m_pStagingRing);
+	}
+
+	m_pSphereGeomBuffer->Update(m_Spheres.data(), m_Spheres.size() * sizeof(Sphere), m_pStagingRing);
+	m_ResetAccumulation = true;
+}
+
+void VulkanApp::BuildSphereBVH()
+{
+	std::vector<AABB> sphereBounds(m_Spheres.size());
+	for (size_t i = 0; i < m_Spheres.size(); i++)
+	{
+		sphereBounds[i].Grow(m_Spheres[i].pos - glm::vec3(m_Spheres[i].radius));
+		sphereBounds[i].Grow(m_Spheres[i].pos + glm::vec3(m_Spheres[i].radius));
+	}
+	m_SphereBVH.Build(sphereBounds, 4, m_pThreadPool);
+	m_SphereBVHBuildCost = m_SphereBVH.GetSAHCost();
+	m_SphereWideBVH.Build(m_SphereBVH.GetNodes());
+	CheckTraversalStack("Spheres", m_SphereBVH, &m_SphereWideBVH);
+
+	// Same as for the triangles the spheres are stored in leaf order
+	std::vector<Sphere> sortedSpheres(m_Spheres.size());
+	for (size_t i = 0; i < m_Spheres.size(); i++)
+	{
+		sortedSpheres[i] = m_Spheres[m_SphereBVH.GetPrimitiveIndices()[i]];
+	}
+	m_Spheres.swap(sortedSpheres);
+}
+
+uint32_t VulkanApp::AddInstance(uint32_t meshId, const glm::mat4& transform)
+{
+	assert(meshId < m_Meshes.size() && "Invalid mesh id!");
+	m_Instances.push_back(Instance{ meshId, transform });
+	m_InstancesDirty = true;
+	return uint32_t(m_Instances.size() - 1);
+}
+
+void VulkanApp::SetInstanceTransform(uint32_t instanceId, const glm::mat4& transform)
+{
+	assert(instanceId < m_Instances.size() && "Invalid instance id!");
+	m_Instances[instanceId].transform = transform;
+	m_InstancesDirty = true;
+}
+
+void VulkanApp::SetAnimateSpheres(bool animate)
+{
+	m_AnimateSpheres = animate;
+}
+
+void VulkanApp::SetGPUSphereBVH(bool enabled)
+{
+	m_BuildSphereBVHOnGPU = enabled;
+}
+
+void VulkanApp::SetPrecomputedTriangles(bool enabled)
+{
+	m_UsePrecomputedTriangles = enabled;
+}
+
+void VulkanApp::SubmitSphereBVHBuild(uint32_t frame)
+{
+	// The slot's previous build finished before the trace that followed it
+	VkCommandBuffer commandBuffer = m_SphereBuildCommandBuffers[frame];
+	VkCommandBufferBeginInfo commandBufferBeginInfo{};
+	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	ErrorCheck(vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo));
+	m_pSphereLBVHBuilder->RecordBuild(commandBuffer);
+	ErrorCheck(vkEndCommandBuffer(commandBuffer));
+
+	// Submitted ahead of the trace on the same queue, the leading barrier of the trace makes the nodes visible
+	m_pComputeTimeline->Submit(commandBuffer);
+	m_SphereBVHBuildPending = false;
+}
+
+void VulkanApp::UpdateInstances()
+{
+	if (!m_InstancesDirty)
+		return;
+	m_InstancesDirty = false;
+	m_ResetAccumulation = true;
+
+	// Top level BVH over the world space bounds of every instance
+	std::vector<AABB> instanceBounds(m_Instances.size());
+	for (size_t i = 0; i < m_Instances.size(); i++)
+	{
+		const AABB& meshBounds = m_Meshes[m_Instances[i].meshId].bounds;
+		for (int corner = 0; corner < 8; corner++)
+		{
+			glm::vec3 point{ (corner & 1) ? meshBounds.max.x : meshBounds.min.x, (corner & 2) ? meshBounds.max.y : meshBounds.min.y, (corner & 4) ? meshBounds.max.z : meshBounds.min.z };
+			instanceBounds[i].Grow(glm::vec3(m_Instances[i].transform * glm::vec4(point, 1.f)));
+		}
+	}
+	BVH instanceBVH{};
+	instanceBVH.Build(instanceBounds, 1);
+	CheckTraversalStack("Instances", instanceBVH, nullptr);
+
+	std::vector<BVHNode> nodes = instanceBVH.GetNodes();
+	if (nodes.empty())
+	{
+		// Empty leaf so the shader never has to check for an empty hierarchy
+		AABB empty{};
+		nodes.push_back(BVHNode{ empty.min, 0, empty.max, BVH_LEAF_BIT });
+	}
+
+	std::vector<GPUInstance> gpuInstances(std::max(m_Instances.size(), size_t(1)));
+	for (size_t i = 0; i < m_Instances.size(); i++)
+	{
+		const Instance& instance = m_Instances[instanceBVH.GetPrimitiveIndices()[i]];
+		gpuInstances[i].worldToObject = glm::inverse(instance.transform);
+		gpuInstances[i].rootNode = m_Meshes[instance.meshId].rootNode;
+		gpuInstances[i].wideRootNode = m_Meshes[instance.meshId].wideRootNode;
+		gpuInstances[i].meshId = instance.meshId;
+		gpuInstances[i].material = m_Meshes[instance.meshId].material;
+	}
+
+	if (gpuInstances.size() > m_InstanceCapacity)
+	{
+		// Grow the buffers. The traces submitted so far keep the old ones, they are destroyed once those completed
+		// and the set of every frame is rewritten when its slot comes up.
+		vkw::Buffer* pOldInstanceBuffer = m_pInstanceBuffer;
+		vkw::Buffer* pOldInstanceBVHBuffer = m_pInstanceBVHBuffer;
+		if (m_pComputeTimeline != nullptr)
+		{
+			m_pComputeTimeline->DeferDestruction([pOldInstanceBuffer, pOldInstanceBVHBuffer]()
+			{
+				delete pOldInstanceBuffer;
+				delete pOldInstanceBVHBuffer;
+			});
+		}
+		else
+		{
+			delete pOldInstanceBuffer;
+			delete pOldInstanceBVHBuffer;
+		}
+
+		m_InstanceCapacity = std::max(m_InstanceCapacity * 2, uint32_t(gpuInstances.size()));
+		m_pInstanceBuffer = new vkw::Buffer(
+			GetDevice(), GetCommandPool(),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			size_t(m_InstanceCapacity * sizeof(GPUInstance)), nullptr
+		);
+		m_pInstanceBVHBuffer = new vkw::Buffer(
+			GetDevice(), GetCommandPool(),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			size_t((m_InstanceCapacity * 2 - 1) * sizeof(BVHNode)), nullptr
+		);
+		m_InstanceDescriptorsDirty.assign(m_InstanceDescriptorsDirty.size(), true);
+	}
+
+	// Ring copies run on the compute queue after every trace submitted so far, so the host never waits for those traces.
+	// The ring only exists once the compute queue is set up, uploads made while the scene is built block.
+	if (m_pStagingRing == nullptr)
+	{
+		m_pInstanceBuffer->Update(gpuInstances.data(), gpuInstances.size() * sizeof(GPUInstance), GetCommandPool());
+		m_pInstanceBVHBuffer->Update(nodes.data(), nodes.size() * sizeof(BVHNode), GetCommandPool());
+		return;
 	}
+	m_pInstanceBuffer->Update(gpuInstances.data(), gpuInstances.size() * sizeof(GPUInstance), m_pStagingRing);
+	m_pInstanceBVHBuffer->Update(nodes.data(), nodes.size() * sizeof(BVHNode), m_pStagingRing);
+}
 
-	m_Spheres.size() * sizeof(Sphere), (void*)m_Spheres.data();
-	m_pSphereGeomBuffer->Update((void*)m_Spheres.data(), m_Spheres.size() * sizeof(Sphere), GetCommandPool());
+void VulkanApp::WriteInstanceDescriptors(uint32_t frame)
+{
+	std::array<VkWriteDescriptorSet, 2> writeDescriptorSets{};
+	writeDescriptorSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	writeDescriptorSets[0].descriptorCount = 1;
+	writeDescriptorSets[0].dstBinding = 8;
+	writeDescriptorSets[0].dstSet = m_ComputeDescriptorSets[frame];
+	writeDescriptorSets[0].pBufferInfo = &m_pInstanceBVHBuffer->GetDescriptor();
+
+	writeDescriptorSets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	writeDescriptorSets[1].descriptorCount = 1;
+	writeDescriptorSets[1].dstBinding = 9;
+	writeDescriptorSets[1].dstSet = m_ComputeDescriptorSets[frame];
+	writeDescriptorSets[1].pBufferInfo = &m_pInstanceBuffer->GetDescriptor();
+
+	vkUpdateDescriptorSets(GetDevice()->GetDevice(), writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
 }
 
 void VulkanApp::CreateCubeMap()
@@ -646,23 +1711,20 @@ void VulkanApp::CreateCubeMap()
 	m_CubeMap.mipLevels = texCube.levels();
 
 
-	CreateImage(GetDevice()->GetDevice(), GetDevice()->GetPhysicalDeviceMemoryProperties(),
+	CreateImage(GetDevice()->GetDevice(), GetDevice()->GetAllocator(),
 		m_CubeMap.width, m_CubeMap.height,
 		format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		m_CubeMap.image, m_CubeMap.memory, 6, m_CubeMap.mipLevels, VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT
+		m_CubeMap.image, m_CubeMap.allocation, 6, m_CubeMap.mipLevels, VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT
 	);
 
 	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory; 
+	vkw::Allocation stagingAllocation; 
 
 
-	CreateBuffer(GetDevice()->GetDevice(), GetDevice()->GetPhysicalDeviceMemoryProperties(), texCube.size(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+	CreateBuffer(GetDevice()->GetDevice(), GetDevice()->GetAllocator(), texCube.size(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingAllocation);
 
-	uint8_t *data;
-	ErrorCheck(vkMapMemory(GetDevice()->GetDevice(), stagingBufferMemory, 0, texCube.size(), 0, (void **)&data));
-	memcpy(data, texCube.data(), texCube.size());
-	vkUnmapMemory(GetDevice()->GetDevice(), stagingBufferMemory);
+	memcpy(stagingAllocation.pMappedData, texCube.data(), texCube.size());
 
 	
 	std::vector<VkBufferImageCopy> bufferCopyRegions;
@@ -735,8 +1797,8 @@ void VulkanApp::CreateCubeMap()
 	view.image = m_CubeMap.image;
 	ErrorCheck(vkCreateImageView(GetDevice()->GetDevice(), &view, nullptr, &m_CubeMap.imageView));
 
-	vkFreeMemory(GetDevice()->GetDevice(), stagingBufferMemory, nullptr);
 	vkDestroyBuffer(GetDevice()->GetDevice(), stagingBuffer, nullptr);
+	GetDevice()->GetAllocator()->Free(stagingAllocation);
 	
 	m_CubeMap.descriptor.sampler = m_CubeMap.sampler;
 	m_CubeMap.descriptor.imageLayout = m_CubeMap.imageLayout;
@@ -746,8 +1808,18 @@ void VulkanApp::CreateCubeMap()
 void VulkanApp::DestroyStorageBuffers()
 {
 	delete m_pSphereGeomBuffer;
+	delete m_pSphereBVHBuffer;
+	delete m_pSphereLBVHBuilder;
+	delete m_pSphereWideBVHBuffer;
+	delete m_pTriangleWideBVHBuffer;
 	delete m_pPlaneGeomBuffer;
 	delete m_pTriangleGeomBuffer;
+	delete m_pVertexBuffer;
+	delete m_pMaterialBuffer;
+	delete m_pWorkCounterBuffer;
+	delete m_pTriangleBVHBuffer;
+	delete m_pInstanceBuffer;
+	delete m_pInstanceBVHBuffer;
 }
 
 void VulkanApp::DestroyUniformBuffers()
@@ -760,12 +1832,20 @@ void VulkanApp::DestroyCubeMap()
 	vkDestroySampler(GetDevice()->GetDevice(), m_CubeMap.sampler, nullptr);
 	vkDestroyImageView(GetDevice()->GetDevice(), m_CubeMap.imageView, nullptr);
 	vkDestroyImage(GetDevice()->GetDevice(), m_CubeMap.image, nullptr);
-	vkFreeMemory(GetDevice()->GetDevice(), m_CubeMap.memory, nullptr);
+	GetDevice()->GetAllocator()->Free(m_CubeMap.allocation);
 }
 
-void VulkanApp::DestroyTextureSamples()
+void VulkanApp::DestroyAccumulationTexture()
 {
-	delete m_pSampleTextures;
+	delete m_pAccumulationTexture;
+	for (vkw::Texture* pDisplayImage : m_pDisplayImages)
+	{
+		delete pDisplayImage;
+	}
+	m_pDisplayImages.clear();
+	delete m_pMomentBuffer;
+	delete m_pTileListBuffer;
+	delete m_pFeatureBuffer;
 }
 
 void VulkanApp::DestroyGraphicsPipeline()
@@ -780,26 +1860,190 @@ void VulkanApp::DestroyDescriptorPool()
 	vkDestroyDescriptorPool(GetDevice()->GetDevice(), m_DescriptorPool, nullptr);
 }
 
+void VulkanApp::DestroyDenoiser()
+{
+	delete m_pDenoiser;
+}
+
 void VulkanApp::DestroyComputePipeline()
 {
-	vkDestroyPipeline(GetDevice()->GetDevice(), m_ComputePipeline, nullptr);
+	delete m_pTemporalReprojection;
+	delete m_pWavefrontTracer;
+	DestroyTracePipelines();
 	vkDestroyPipelineLayout(GetDevice()->GetDevice(), m_ComputePipelineLayout, nullptr);
 	vkDestroyDescriptorSetLayout(GetDevice()->GetDevice(), m_ComputeDescriptorSetLayout, nullptr);
-	vkDestroyFence(GetDevice()->GetDevice(), m_ComputeFence, nullptr);
+	delete m_pStagingRing;
+	delete m_pComputeTimeline;
 	vkDestroyCommandPool(GetDevice()->GetDevice(), m_ComputeCommandPool, nullptr);
 }
 
-std::vector<VulkanApp::Triangle> VulkanApp::LoadModel(std::string filePath, uint32_t& currentId)
+uint32_t VulkanApp::AddMaterial(const Material& material)
+{
+	assert(m_pMaterialBuffer == nullptr && "Materials have to be added before the storage buffers are created!");
+	m_Materials.push_back(material);
+	return uint32_t(m_Materials.size() - 1);
+}
+
+uint32_t VulkanApp::LoadMesh(const std::string& filePath, uint32_t& currentId, uint32_t material)
 {
-	std::vector<glm::vec3> vertices;
-	std::vector<Triangle> tris;
+	assert(m_pTriangleGeomBuffer == nullptr && "Meshes have to be loaded before the storage buffers are created!");
+	MeshGeometry geometry = LoadModel(filePath, currentId);
+	// The bvh of an empty mesh has no root node to take the bounds from
+	if (geometry.triangles.empty())
+	{
+		std::cout << "LoadMesh: " << filePath << " has no triangles" << std::endl;
+		assert("Mesh has no triangles!" && 0);
+		std::exit(-1);
+	}
+	// The wide leaves are made absolute below, so the check of WideBVH::Build does not cover the shared buffer
+	if (m_MeshTriangles.size() + geometry.triangles.size() > WIDE_BVH_FIRST_MASK)
+	{
+		std::cout << "LoadMesh: " << filePath << " does not fit in the wide bvh, the meshes have more than " << WIDE_BVH_FIRST_MASK << " triangles" << std::endl;
+		assert("Too many triangles for the wide bvh!" && 0);
+		std::exit(-1);
+	}
+
+	// Bottom level BVH, stored in object space so every instance of the mesh shares it
+	std::vector<AABB> triangleBounds = GetTriangleBounds(geometry);
+	BVH triangleBVH{};
+	triangleBVH.Build(triangleBounds, 4, m_pThreadPool);
+
+	Mesh mesh{};
+	mesh.rootNode = uint32_t(m_MeshNodes.size());
+	mesh.wideRootNode = uint32_t(m_MeshWideNodes.size());
+	mesh.firstTriangle = uint32_t(m_MeshTriangles.size());
+	mesh.triangleCount = uint32_t(geometry.triangles.size());
+	mesh.bounds = AABB{ triangleBVH.GetNodes()[0].min, triangleBVH.GetNodes()[0].max };
+	mesh.material = material;
+
+	// Node and triangle indices are made absolute so all meshes can share one buffer
+	for (BVHNode node : triangleBVH.GetNodes())
+	{
+		if (node.rightCount & BVH_LEAF_BIT)
+		{
+			node.leftFirst += mesh.firstTriangle;
+		}
+		else
+		{
+			node.leftFirst += mesh.rootNode;
+			node.rightCount += mesh.rootNode;
+		}
+		m_MeshNodes.push_back(node);
+	}
+
+	WideBVH wideTriangleBVH{};
+	wideTriangleBVH.Build(triangleBVH.GetNodes());
+	CheckTraversalStack(filePath, triangleBVH, &wideTriangleBVH);
+	for (WideBVHNode node : wideTriangleBVH.GetNodes())
+	{
+		uint32_t childCount = node.meta >> 24;
+		for (uint32_t i = 0; i < childCount; i++)
+		{
+			node.children[i] += (node.children[i] & BVH_LEAF_BIT) ? mesh.firstTriangle : mesh.wideRootNode;
+		}
+		m_MeshWideNodes.push_back(node);
+	}
+	PrintBVHStats(filePath, triangleBVH, wideTriangleBVH, geometry.triangles.size());
+
+	// Vertex indices are made absolute as well
+	uint32_t firstVertex = uint32_t(m_MeshVertices.size());
+	m_MeshVertices.insert(m_MeshVertices.end(), geometry.vertices.begin(), geometry.vertices.end());
+	for (uint32_t triangleIndex : triangleBVH.GetPrimitiveIndices())
+	{
+		glm::uvec4 triangle = geometry.triangles[triangleIndex];
+		m_MeshTriangles.push_back(glm::uvec4(triangle.x + firstVertex, triangle.y + firstVertex, triangle.z + firstVertex, triangle.w));
+	}
+
+	m_Meshes.push_back(mesh);
+	return uint32_t(m_Meshes.size() - 1);
+}
+
+void VulkanApp::RunBVHBenchmark(const std::string& filePath)
+{
+	uint32_t currentId{ 0 };
+	std::vector<AABB> triangleBounds = GetTriangleBounds(LoadModel(filePath, currentId));
+	std::cout << "BVH benchmark: " << filePath << ", " << triangleBounds.size() << " triangles" << std::endl;
+
+	const uint32_t runCount{ 5 };
+	uint32_t maxThreadCount = std::max(std::thread::hardware_concurrency(), 1u);
+	float serialTime{};
+	for (uint32_t threadCount = 1; ; threadCount = std::min(threadCount * 2, maxThreadCount))
+	{
+		// The thread calling Build works as well, so the pool gets one worker less
+		ThreadPool* pThreadPool = (threadCount > 1) ? new ThreadPool(threadCount - 1) : nullptr;
+		BVH bvh{};
+		float bestTime{ FLT_MAX };
+		for (uint32_t run = 0; run < runCount; run++)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			bvh.Build(triangleBounds, 4, pThreadPool);
+			std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+			bestTime = std::min(bestTime, std::chrono::duration<float, std::milli>(end - start).count());
+		}
+		delete pThreadPool;
+
+		if (threadCount == 1)
+			serialTime = bestTime;
+		std::cout << "Threads: " << threadCount << "\tBuild: " << bestTime << " ms\tSpeedup: " << serialTime / bestTime
+			<< "x\tSAH cost: " << bvh.GetSAHCost() << "\tNodes: " << bvh.GetNodes().size() << std::endl;
+
+		if (threadCount == maxThreadCount)
+		{
+			WideBVH wideBVH{};
+			wideBVH.Build(bvh.GetNodes());
+			PrintBVHStats(filePath, bvh, wideBVH, triangleBounds.size());
+			break;
+		}
+	}
+}
+
+void VulkanApp::PrintBVHStats(const std::string& name, const BVH& bvh, const WideBVH& wideBVH, size_t primitiveCount)
+{
+	size_t binaryBytes = bvh.GetNodes().size() * sizeof(BVHNode);
+	size_t wideBytes = wideBVH.GetNodes().size() * sizeof(WideBVHNode);
+	std::cout << name << ": " << primitiveCount << " primitives"
+		<< "\tBinary: " << bvh.GetNodes().size() << " nodes, " << float(binaryBytes) / primitiveCount << " bytes per primitive"
+		<< "\tWide: " << wideBVH.GetNodes().size() << " nodes, " << float(wideBytes) / primitiveCount << " bytes per primitive" << std::endl;
+}
+
+void VulkanApp::CheckTraversalStack(const std::string& name, const BVH& bvh, const WideBVH* pWideBVH)
+{
+	// Every level above the popped node leaves one sibling on the binary stack and up to three on the wide one,
+	// the deepest interior node then pushes all of its children
+	uint32_t stackSize = bvh.GetMaxDepth() + 1;
+	if (pWideBVH != nullptr)
+	{
+		stackSize = std::max(stackSize, 3 * pWideBVH->GetMaxDepth() + 1);
+	}
+	if (stackSize > BVH_STACK_SIZE)
+	{
+		std::cout << name << ": bvh traversal needs " << stackSize << " stack entries, the shaders have " << BVH_STACK_SIZE << std::endl;
+		assert("BVH is too deep for the traversal stack!" && 0);
+		std::exit(-1);
+	}
+}
+
+void VulkanApp::PrintMemoryStats()
+{
+	const vkw::MemoryStats stats = GetDevice()->GetAllocator()->GetStats();
+	std::cout << "Device memory: " << stats.allocationCount << " allocations"
+		<< "\tBlocks: " << stats.blockCount << ", dedicated: " << stats.dedicatedAllocationCount
+		<< "\tUsed: " << float(stats.usedBytes) / (1024 * 1024) << " of " << float(stats.reservedBytes) / (1024 * 1024) << " MB" << std::endl;
+}
+
+VulkanApp::MeshGeometry VulkanApp::LoadModel(std::string filePath, uint32_t& currentId)
+{
+	MeshGeometry geometry{};
+	// Maps the position index in the file to the deduplicated vertex
+	std::vector<uint32_t> vertexIndices;
+	std::map<std::array<float, 3>, uint32_t> uniqueVertices;
 	std::ifstream input{ filePath };
 	if (input)
 	{
 		std::string line;
 		while (std::getline(input, line, '\n'))
 		{
-			if (line[0] == 'v')
+			if (line.compare(0, 2, "v ") == 0)
 			{
 				std::string junk;
 				float x{};
@@ -807,28 +2051,36 @@ std::vector<VulkanApp::Triangle> VulkanApp::LoadModel(std::string filePath, uint
 				float z{};
 				std::istringstream sLine{ line };
 				sLine >> junk >> x >> y >> z;
-				vertices.push_back({ x, y, z });
+				auto result = uniqueVertices.insert({ { x, y, z }, uint32_t(geometry.vertices.size()) });
+				if (result.second)
+				{
+					geometry.vertices.push_back({ x, y, z, 1.f });
+				}
+				vertexIndices.push_back(result.first->second);
 			}
 			else
 			{
 				if (line[0] == 'f')
 				{
-					size_t idx1;
-					size_t idx2;
-					size_t idx3;
+					// Polygons are split in a triangle fan
+					std::vector<uint32_t> face;
+					size_t idx;
 					std::istringstream sLine{ line };
 					std::string junk;
-					sLine >> junk >> idx1 >> idx2 >> idx3;
-					glm::vec3 v1 = vertices[idx1 - 1];
-					glm::vec3 v2 = vertices[idx2 - 1];
-					glm::vec3 v3 = vertices[idx3 - 1];
-					glm::vec3 n = glm::cross(v2 - v1, v3 - v1);
-					tris.push_back({ v1, ++currentId, v2, 32.f, v3, 0, n, 0, { 0.65f, 0.77f, 0.97f } });
+					sLine >> junk;
+					while (sLine >> idx)
+					{
+						face.push_back(vertexIndices[idx - 1]);
+					}
+					for (size_t i = 2; i < face.size(); i++)
+					{
+						geometry.triangles.push_back({ face[0], face[i - 1], face[i], ++currentId });
+					}
 				}
 			}
 
 		}
-		return tris;
+		return geometry;
 	}else
 	{
 		assert("File not found" && 0);
@@ -836,14 +2088,29 @@ std::vector<VulkanApp::Triangle> VulkanApp::LoadModel(std::string filePath, uint
 	}
 }
 
+std::vector<AABB> VulkanApp::GetTriangleBounds(const MeshGeometry& geometry)
+{
+	std::vector<AABB> triangleBounds(geometry.triangles.size());
+	for (size_t i = 0; i < geometry.triangles.size(); i++)
+	{
+		triangleBounds[i].Grow(glm::vec3(geometry.vertices[geometry.triangles[i].x]));
+		triangleBounds[i].Grow(glm::vec3(geometry.vertices[geometry.triangles[i].y]));
+		triangleBounds[i].Grow(glm::vec3(geometry.vertices[geometry.triangles[i].z]));
+	}
+	return triangleBounds;
+}
+
 
 
 
 
-void VulkanApp::BuildDrawCommandBuffers()
+void VulkanApp::RecordDrawCommandBuffer(uint32_t frame, uint32_t imageIndex)
 {
+	// Recorded every frame, Render waited for the graphics timeline value the command buffer signaled last
+	VkCommandBuffer commandBuffer = GetDrawCommandBuffers()[frame];
 	VkCommandBufferBeginInfo commandBufferBeginInfo{};
 	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
 	VkClearValue clearValues[2];
 	clearValues[0].color = { 0.5f, 0.5f, 0.5f, 1.f };
@@ -857,55 +2124,34 @@ void VulkanApp::BuildDrawCommandBuffers()
 	renderPassBeginInfo.renderArea.extent = GetWindow()->GetSurfaceSize();
 	renderPassBeginInfo.clearValueCount = 2;
 	renderPassBeginInfo.pClearValues = clearValues;
+	renderPassBeginInfo.framebuffer = GetFrameBuffers()[imageIndex]->GetHandle();
 
-	for (int32_t i = 0; i < GetDrawCommandBuffers().size(); ++i)
-	{
-		// Set target frame buffer
-		renderPassBeginInfo.framebuffer = GetFrameBuffers()[i]->GetHandle();
-
-		ErrorCheck(vkBeginCommandBuffer(GetDrawCommandBuffers()[i], &commandBufferBeginInfo));
-
-		VkImageMemoryBarrier imageMemoryBarrier{};
-		imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
-		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
-		imageMemoryBarrier.image = m_pSampleTextures->GetImage();
-		imageMemoryBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-		vkCmdPipelineBarrier(
-			GetDrawCommandBuffers()[i],
-			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-			0,
-			0, nullptr,
-			0, nullptr,
-			1, &imageMemoryBarrier
-		);
+	ErrorCheck(vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo));
 
-		vkCmdBeginRenderPass(GetDrawCommandBuffers()[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	// The copy into the display image is made visible by the wait on the compute timeline value of the trace
+	vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-		VkViewport viewport{};
-		viewport.x = 0;
-		viewport.y = 0;
-		viewport.width = GetWindow()->GetSurfaceSize().width;
-		viewport.height = GetWindow()->GetSurfaceSize().height;
-		vkCmdSetViewport(GetDrawCommandBuffers()[i], 0, 1, &viewport);
+	VkViewport viewport{};
+	viewport.x = 0;
+	viewport.y = 0;
+	viewport.width = GetWindow()->GetSurfaceSize().width;
+	viewport.height = GetWindow()->GetSurfaceSize().height;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
-		VkRect2D scissor{};
-		scissor.extent = GetWindow()->GetSurfaceSize();
-		scissor.offset = { 0,0 };
+	VkRect2D scissor{};
+	scissor.extent = GetWindow()->GetSurfaceSize();
+	scissor.offset = { 0,0 };
 
-		vkCmdSetScissor(GetDrawCommandBuffers()[i], 0, 1, &scissor);
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-		// Display ray traced image generated by compute shader as a full screen quad
-		// Quad vertices are generated in the vertex shader
-		vkCmdBindDescriptorSets(GetDrawCommandBuffers()[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_GraphicsPipelineLayout, 0, 1, &m_GraphicsDescriptorSet, 0, NULL);
-		vkCmdBindPipeline(GetDrawCommandBuffers()[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_GraphicsPipeline);
-		vkCmdDraw(GetDrawCommandBuffers()[i], 3, 1, 0, 0);
+	// Display ray traced image generated by compute shader as a full screen quad
+	// Quad vertices are generated in the vertex shader
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_GraphicsPipelineLayout, 0, 1, &m_GraphicsDescriptorSets[frame], 0, NULL);
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_GraphicsPipeline);
+	vkCmdPushConstants(commandBuffer, m_GraphicsPipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(glm::uvec2), &m_UniformBufferData.traceSize);
+	vkCmdDraw(commandBuffer, 3, 1, 0, 0);
 
-		vkCmdEndRenderPass(GetDrawCommandBuffers()[i]);
+	vkCmdEndRenderPass(commandBuffer);
 
-		ErrorCheck(vkEndCommandBuffer(GetDrawCommandBuffers()[i]));
-	}
+	ErrorCheck(vkEndCommandBuffer(commandBuffer));
 }
@@ -1,11 +1,22 @@
 #pragma once
 #include "VulkanBaseApp.h"
+#include "BVH.h"
+#include "WideBVH.h"
+#include "MemoryAllocator.h"
 #include <glm/glm.hpp>
 #include <array>
 namespace vkw {
 	class Buffer;
 	class Texture;
+	class TimestampQuery;
+	class QueueTimeline;
+	class StagingRing;
 }
+class ThreadPool;
+class LBVHBuilder;
+class WavefrontTracer;
+class Denoiser;
+class TemporalReprojection;
 class VulkanApp : vkw::VulkanBaseApp
 {
 public:
@@ -16,80 +27,220 @@ public:
 	void Init(float width, float height) override;
 	void Cleanup() override;
 
+	// Places a mesh loaded with LoadMesh in the scene, returns the instance id
+	uint32_t AddInstance(uint32_t meshId, const glm::mat4& transform);
+	void SetInstanceTransform(uint32_t instanceId, const glm::mat4& transform);
+	// When enabled Init benchmarks the trace kernel configurations and stores the fastest for this device in TuningCachePath,
+	// otherwise a configuration stored earlier is loaded from it
+	void SetAutotune(bool autotune);
+	// Gpu time of the compute frame the dynamic resolution scaling aims for
+	void SetTargetFrameTime(float milliseconds);
+	// Frames recorded ahead of the gpu, the trace of the next frame overlaps the composite of the current one. Has to be set before Init.
+	void SetFramesInFlight(uint32_t frameCount);
+	// Builds the sphere bvh on the gpu whenever the spheres changed instead of refitting it on the cpu. Has to be set before Init.
+	void SetGPUSphereBVH(bool enabled);
+	// Moves the spheres every frame, their bvh is refit or rebuilt on the gpu. Toggled with G.
+	void SetAnimateSpheres(bool animate);
+	// Uploads the triangles with their edges precomputed instead of as indices into the vertex buffer. Has to be set before Init.
+	void SetPrecomputedTriangles(bool enabled);
+
+	// Builds the bvh of the model with an increasing amount of threads and prints build time and SAH cost, no device needed
+	static void RunBVHBenchmark(const std::string& filePath);
+
 private:
 	
 	void CreateStorageBuffers();
 	void CreateUniformBuffers();
 	void UpdateUniformBuffers();
-	void CreateSampleTextures();
+	void CreateAccumulationTexture();
 	void CreateCubeMap();
 	void CreateGraphicsPipeline();
 	void CreateDescriptorPool();
 	void CreateDescriptorSet();
 	void CreateComputePipeline();
-	void BuildDrawCommandBuffers();
+	void CreateDenoiser();
+	VkSpecializationInfo GetTraceSpecializationInfo() const;
+	void CreateTracePipelines();
+	void DestroyTracePipelines();
+	void RecordDrawCommandBuffer(uint32_t frame, uint32_t imageIndex);
 	void BuildComputeCommandBuffers();
+	void RecordComputeCommandBuffer(uint32_t frame);
 	void UpdateSpheres();
+	void BuildSphereBVH();
+	void SubmitSphereBVHBuild(uint32_t frame);
+	void UpdateInstances();
+	void WriteInstanceDescriptors(uint32_t frame);
+	void ReportTraceTimings(uint32_t frame);
+	// Scales the traced rectangle so the compute frame holds m_TargetFrameTime, called with the time of every finished frame
+	void UpdateResolutionScale(float computeMilliseconds);
+	void SetResolutionScale(float scale);
+	static void PrintBVHStats(const std::string& name, const BVH& bvh, const WideBVH& wideBVH, size_t primitiveCount);
+	// Exits when the shader traversal of either bvh could need more than BVH_STACK_SIZE entries, the wide bvh is optional
+	static void CheckTraversalStack(const std::string& name, const BVH& bvh, const WideBVH* pWideBVH);
+	void PrintMemoryStats();
 
 	void DestroyStorageBuffers();
 	void DestroyUniformBuffers();
 	void DestroyCubeMap();
-	void DestroyTextureSamples();
+	void DestroyAccumulationTexture();
 	void DestroyGraphicsPipeline();
 	void DestroyDescriptorPool();
+	void DestroyDenoiser();
 	void DestroyComputePipeline();
 
 	vkw::Buffer*								m_pSphereGeomBuffer = nullptr;
+	vkw::Buffer*								m_pSphereBVHBuffer = nullptr;
+	vkw::Buffer*								m_pSphereWideBVHBuffer = nullptr;
 	vkw::Buffer*								m_pPlaneGeomBuffer = nullptr;
 	vkw::Buffer*								m_pTriangleGeomBuffer = nullptr;
+	vkw::Buffer*								m_pVertexBuffer = nullptr;
+	vkw::Buffer*								m_pTriangleBVHBuffer = nullptr;
+	vkw::Buffer*								m_pTriangleWideBVHBuffer = nullptr;
+	vkw::Buffer*								m_pInstanceBuffer = nullptr;
+	vkw::Buffer*								m_pInstanceBVHBuffer = nullptr;
+	vkw::Buffer*								m_pMaterialBuffer = nullptr;
+	vkw::Buffer*								m_pWorkCounterBuffer = nullptr;
+	uint32_t									m_InstanceCapacity{ 0 };
+	bool										m_InstancesDirty{ false };
+	// Set per frame after the instance buffers grew, the frame's descriptor set is rewritten before its next trace
+	std::vector<bool>							m_InstanceDescriptorsDirty{};
+
+	ThreadPool*									m_pThreadPool = nullptr;
 
 	vkw::Buffer*								m_pUniformBuffer = nullptr;
 
-	static const uint32_t						m_SampleCount{ 8 };
-	uint32_t									m_MostRecentSample{ 0 };
-	uint32_t									m_CurrentNrOfSamples{ 0 };
-	vkw::Texture*								m_pSampleTextures = nullptr;
+	// Running mean of every sample since the camera or the scene last changed
+	vkw::Texture*								m_pAccumulationTexture = nullptr;
+	// Copy of the accumulation or the denoised image per frame in flight, sampled by texture.frag while the next frame is traced
+	std::vector<vkw::Texture*>					m_pDisplayImages{};
+	bool										m_ResetAccumulation{ true };
+	// Running mean of the squared luminance per pixel, the variance of the adaptive sampling error estimate comes from it
+	vkw::Buffer*								m_pMomentBuffer = nullptr;
+	// Indirect dispatch arguments followed by the tiles picked by the schedule pass, allocated for tiles of MinTileWidth x MinTileHeight
+	vkw::Buffer*								m_pTileListBuffer = nullptr;
+	static const uint32_t						MinTileWidth{ 8 };
+	static const uint32_t						MinTileHeight{ 4 };
+	// Primary hit features for the denoiser
+	vkw::Buffer*								m_pFeatureBuffer = nullptr;
+	glm::vec4									m_AccumulationCameraPos{};
+	glm::vec4									m_AccumulationCameraForward{};
 
 
+	// Shading data shared by every primitive that indexes it, matches Material in raytracing.comp
+	struct Material {
+		glm::vec3 diffuse;
+		float reflectance;
+	};
+	std::vector<Material>						m_Materials;
+
 	struct Sphere {									
 		glm::vec3 pos;
 		float radius;
-		glm::vec3 diffuse;
-		uint32_t id;								
+		uint32_t material;
+		uint32_t id;
+		uint32_t pad1;
+		uint32_t pad2;
 	};
 	std::vector<Sphere>							m_Spheres;
 
+	// Animated spheres only refit their bvh, it is rebuilt once its SAH cost degraded past the threshold
+	BVH											m_SphereBVH{};
+	WideBVH										m_SphereWideBVH{};
+	float										m_SphereBVHBuildCost{};
+	static constexpr float						m_SphereBVHRebuildThreshold{ 1.5f };
+	bool										m_AnimateSpheres{ false };
+	bool										m_WasAnimateToggleDown{ false };
+	// The gpu build replaces the SAH and wide bvh of the cpu, it is only submitted before a trace when the spheres changed
+	bool										m_BuildSphereBVHOnGPU{ false };
+	LBVHBuilder*								m_pSphereLBVHBuilder = nullptr;
+	bool										m_SphereBVHBuildPending{ false };
+	std::vector<VkCommandBuffer>				m_SphereBuildCommandBuffers{};
+
 	struct Plane {
 		glm::vec3 normal;
 		float distance;
-		glm::vec3 diffuse;
+		uint32_t material;
 		uint32_t id;
+		uint32_t pad1;
+		uint32_t pad2;
 	};
 
-	struct Triangle
-	{
+	// Triangles index a shared vertex buffer, x, y and z are the vertex indices and w holds the id
+	struct MeshGeometry {
+		std::vector<glm::vec4> vertices;
+		std::vector<glm::uvec4> triangles;
+	};
+
+	// Optional layout with the edges precomputed, costs twice the memory of the indexed layout but saves the vertex fetches and edge math per test
+	struct PrecomputedTriangle {
 		glm::vec3 p1;
 		uint32_t id;
-		glm::vec3 p2;
-		float specular;
-		glm::vec3 p3;
-		int pad1;
-		glm::vec3 normal;
-		int pad2;
-		glm::vec3 diffuse;
-		int pad3;
+		glm::vec3 edge1;
+		float pad1;
+		glm::vec3 edge2;
+		float pad2;
+	};
+	bool										m_UsePrecomputedTriangles{ false };
+
+	// Meshes are stored once in object space, all their bvh nodes and triangles are packed in the same buffers
+	struct Mesh {
+		uint32_t rootNode;
+		uint32_t wideRootNode;
+		uint32_t firstTriangle;
+		uint32_t triangleCount;
+		AABB bounds;
+		uint32_t material;
+	};
+	std::vector<Mesh>							m_Meshes;
+	std::vector<glm::vec4>						m_MeshVertices;
+	std::vector<glm::uvec4>						m_MeshTriangles;
+	std::vector<BVHNode>						m_MeshNodes;
+	std::vector<WideBVHNode>					m_MeshWideNodes;
+
+	struct Instance {
+		uint32_t meshId;
+		glm::mat4 transform;
+	};
+	std::vector<Instance>						m_Instances;
+
+	struct GPUInstance {
+		glm::mat4 worldToObject;
+		uint32_t rootNode;
+		uint32_t meshId;
+		uint32_t wideRootNode;
+		uint32_t material;
 	};
 
 	struct UBOCompute {
 		glm::vec3 lightDir;
 		float aspectRatio;
 		glm::vec2 rayOffset{0.f, 0.f};
-		int currentLayer = 0;
+		// Frames accumulated since the last reset, 0 restarts the mean
+		uint32_t accumulatedFrames = 0;
 		float fov = 10.0f;
 		glm::vec4 pos = { 0.0f, 0.0f, 4.0f, 1.f };
 		glm::vec4 forward{ 0.0f, -1.0f, -1.0f, 0.f };
 		glm::vec4 right{ 1.f, 0.f, 0.f, 0.f };
 		glm::vec4 up{ 0.f, 1.f, 0.f, 0.f };
+		uint32_t traceFlags{ 0 };
+		// Russian roulette starts deciding from bounce rouletteDepth on, the maximum depth is a specialization constant
+		uint32_t rouletteDepth{ 2 };
+		uint32_t frameIndex{ 0 };
+		// Adaptive sampling traces every tile for the first minimumAdaptiveFrames, after that only tiles whose relative error
+		// is above varianceThreshold, with up to maxTileSamples samples per frame
+		float varianceThreshold{ 0.02f };
+		uint32_t minimumAdaptiveFrames{ 8 };
+		uint32_t maxTileSamples{ 4 };
+		// Reprojected history counts as at most maxHistoryFrames samples, so it can still follow changes in shading
+		uint32_t maxHistoryFrames{ 32 };
+		uint32_t pad;
+		// Camera of the accumulated history, only read by the reprojection in frames in which the camera moved
+		glm::vec4 previousPos{};
+		glm::vec4 previousForward{};
+		glm::vec4 previousRight{};
+		glm::vec4 previousUp{};
+		// Traced rectangle at the top left of the accumulation image, see UpdateResolutionScale
+		glm::uvec2 traceSize{};
 
 	} m_UniformBufferData;
 
@@ -98,7 +249,7 @@ private:
 		VkImage image;
 		VkImageView imageView;
 		VkImageLayout imageLayout;
-		VkDeviceMemory memory;
+		vkw::Allocation allocation;
 		float width;
 		float height;
 		uint32_t mipLevels;
@@ -107,12 +258,15 @@ private:
 	} m_CubeMap;
 
 
-	std::vector<Triangle> LoadModel(std::string filePath, uint32_t& currentId);
+	static MeshGeometry LoadModel(std::string filePath, uint32_t& currentId);
+	static std::vector<AABB> GetTriangleBounds(const MeshGeometry& geometry);
+	uint32_t LoadMesh(const std::string& filePath, uint32_t& currentId, uint32_t material);
+	uint32_t AddMaterial(const Material& material);
 
 	VkPipeline				m_GraphicsPipeline = VK_NULL_HANDLE;
 	VkPipelineLayout		m_GraphicsPipelineLayout = VK_NULL_HANDLE;
 	VkDescriptorSetLayout	m_GraphicsDescriptorSetLayout = VK_NULL_HANDLE;
-	VkDescriptorSet			m_GraphicsDescriptorSet = VK_NULL_HANDLE;
+	std::vector<VkDescriptorSet>	m_GraphicsDescriptorSets{};
 
 	VkDescriptorPool		m_DescriptorPool = VK_NULL_HANDLE;
 
@@ -120,11 +274,126 @@ private:
 	VkPipeline				m_ComputePipeline = VK_NULL_HANDLE;
 	VkPipelineLayout		m_ComputePipelineLayout;
 	VkCommandPool			m_ComputeCommandPool = VK_NULL_HANDLE;
-	VkCommandBuffer			m_ComputeCommandBuffer = VK_NULL_HANDLE;
-	VkFence					m_ComputeFence = VK_NULL_HANDLE;
-	VkDescriptorSet			m_ComputeDescriptorSet = VK_NULL_HANDLE;
+	// Per frame in flight, the composite waits for the trace on the compute timeline
+	std::vector<VkCommandBuffer>	m_ComputeCommandBuffers{};
+	vkw::QueueTimeline*				m_pComputeTimeline = nullptr;
+	// Updates of device local buffers, flushed on the compute queue right before the trace of the next frame
+	vkw::StagingRing*				m_pStagingRing = nullptr;
+	static const VkDeviceSize		StagingRingSize{ 16 * 1024 * 1024 };
+	// Timeline values of the last trace and composite of every frame slot
+	std::vector<uint64_t>			m_FrameComputeValues{};
+	std::vector<uint64_t>			m_FrameGraphicsValues{};
+	uint32_t				m_CurrentFrame{ 0 };
+	std::vector<VkDescriptorSet>	m_ComputeDescriptorSets{};
 	VkDescriptorSetLayout	m_ComputeDescriptorSetLayout = VK_NULL_HANDLE;
 
+	// Selects the bvh and triangle layouts raytracing.comp traverses, B switches between the binary and the wide bvh layouts
+	enum TraceFlags : uint32_t
+	{
+		WideTriangleBVH = 1,
+		WideSphereBVH = 2,
+		PrecomputedTriangles = 4
+	};
+	bool					m_WasBVHToggleDown{ false };
+
+	// M cycles through the trace modes, the command buffers are rebuilt once the last trace finished
+	enum TraceMode : uint32_t
+	{
+		MegakernelTraceMode,
+		// raytracing.comp compiled with PERSISTENT_THREADS, a fixed amount of groups fetch pixels from an atomic counter until all are done
+		PersistentTraceMode,
+		WavefrontTraceMode,
+		// A schedule pass lists the tiles whose error is still above the threshold, the megakernel only traces those through an indirect dispatch
+		AdaptiveTraceMode,
+		TraceModeCount
+	};
+	TraceMode				m_TraceMode{ MegakernelTraceMode };
+	bool					m_WasTraceModeToggleDown{ false };
+	VkPipeline				m_PersistentComputePipeline = VK_NULL_HANDLE;
+	VkPipeline				m_AdaptiveComputePipeline = VK_NULL_HANDLE;
+	VkPipeline				m_TileSchedulePipeline = VK_NULL_HANDLE;
+	uint32_t				m_PersistentGroupCount{ 512 };
+	WavefrontTracer*		m_pWavefrontTracer = nullptr;
+	std::vector<bool>		m_ComputeCommandBufferDirty{};
+
+	// F toggles the denoiser between the trace and the composite, its output is then displayed instead of the accumulation
+	Denoiser*				m_pDenoiser = nullptr;
+	bool					m_DenoiseEnabled{ false };
+	bool					m_WasDenoiseToggleDown{ false };
+
+	// T toggles reprojecting the accumulation when the camera moves, without it the accumulation restarts
+	TemporalReprojection*	m_pTemporalReprojection = nullptr;
+	bool					m_ReprojectEnabled{ true };
+	bool					m_WasReprojectToggleDown{ false };
+
+	// Specialization constants of raytracing.comp and the wavefront passes, the constant id is the index of the member.
+	// The primitive flags are filled in from the loaded scene, so traversals of primitive types it does not contain are compiled out.
+	struct TraceSpecialization
+	{
+		uint32_t maxDepth{ 8 };
+		float epsilon{ 0.0f };
+		float maxLength{ 1000.0f };
+		VkBool32 hasSpheres{ VK_TRUE };
+		VkBool32 hasPlanes{ VK_TRUE };
+		VkBool32 hasTriangles{ VK_TRUE };
+		uint32_t workGroupSizeX{ 16 };
+		uint32_t workGroupSizeY{ 16 };
+	} m_TraceSpecialization;
+
+	// Records the megakernel, persistent threads or adaptive dispatch, the wavefront tracer records its own passes
+	void RecordTraceDispatch(VkCommandBuffer commandBuffer, TraceMode mode, uint32_t frame);
+
+	// Autotuning of the local size and persistent group count, the results are cached per device (vendor, device id and driver version)
+	void Autotune();
+	// Fastest of a few runs in milliseconds, the sphere bvh build is excluded
+	float BenchmarkTraceDispatch(TraceMode mode);
+	void LoadTuning();
+	void SaveTuning();
+	static constexpr const char*	TuningCachePath{ "autotune.cache" };
+	bool							m_Autotune{ false };
+
+	// Timestamps around the compute frame, the raytracing dispatch and the denoiser, trace timings are kept per bvh layout and tracer
+	enum Timestamps : uint32_t
+	{
+		ComputeBeginTimestamp,
+		TraceBeginTimestamp,
+		TraceEndTimestamp,
+		DenoiseEndTimestamp,
+		TimestampCount
+	};
+	// What the last compute submit of a frame slot traced, reported once it completed with the timestamps of that slot
+	struct TraceSubmit
+	{
+		bool		submitted;
+		uint32_t	traceFlags;
+		TraceMode	mode;
+		bool		denoise;
+		uint32_t	tracePixels;
+	};
+	std::vector<vkw::TimestampQuery*>	m_TimestampQueries{};
+	std::vector<TraceSubmit>			m_TraceSubmits{};
+	float					m_DenoiseTime{};
+	uint32_t				m_DenoisedFrames{};
+	std::array<float, 2 * TraceModeCount>		m_TraceTime{};
+	std::array<uint32_t, 2 * TraceModeCount>	m_TracedFrames{};
+	// Only the wavefront tracer counts its rays
+	std::array<double, 2 * TraceModeCount>		m_TracedRays{};
+	std::array<double, 2 * TraceModeCount>		m_TracedPixels{};
+
+	// Dynamic resolution: the images are allocated at the window size and only a rectangle of them is traced and upscaled by texture.frag.
+	// Every change restarts the accumulation, so the scale only moves when the averaged time leaves a band around the target
+	// and not before the previous change settled. R toggles the scaling.
+	bool					m_DynamicResolution{ true };
+	bool					m_WasDynamicResolutionToggleDown{ false };
+	float					m_TargetFrameTime{ 16.6f };
+	float					m_ResolutionScale{ 1.f };
+	float					m_AverageComputeTime{};
+	uint32_t				m_FramesSinceResolutionChange{};
+	static constexpr float	MinResolutionScale{ 0.25f };
+	static const uint32_t	ResolutionSettleFrames{ 30 };
+	// The trace size is a multiple of this, so small changes of the scale do not restart the accumulation
+	static const uint32_t	TraceSizeGranularity{ 8 };
+
 	float					m_AccuTime{};
 	glm::vec2				m_PrevMousePosition{};
 	glm::vec2				m_CameraRotation{};
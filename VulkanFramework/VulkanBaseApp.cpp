@@ -7,6 +7,8 @@
 #include "RenderPass.h"
 #include "FrameBuffer.h"
 #include "CommandPool.h"
+#include "QueueTimeline.h"
+#include <cassert>
 
 using namespace vkw;
 
@@ -48,6 +50,17 @@ std::string VulkanBaseApp::GetName()
 	return m_AppName;
 }
 
+void VulkanBaseApp::SetFramesInFlight(uint32_t frameCount)
+{
+	assert(frameCount > 0 && m_PresentCompleteSemaphores.empty() && "The frames in flight have to be set before Init!");
+	m_FramesInFlight = frameCount;
+}
+
+uint32_t VulkanBaseApp::GetFramesInFlight()
+{
+	return m_FramesInFlight;
+}
+
 void VulkanBaseApp::InitWindow(float width, float height)
 {
 	m_pWindow = new Window(this, m_pDevice, width, height);
@@ -55,21 +68,19 @@ void VulkanBaseApp::InitWindow(float width, float height)
 
 void VulkanBaseApp::InitSynchronizations()
 {
-	//Semaphores
+	//Semaphores, the swapchain only works with binary ones
 	VkSemaphoreCreateInfo semaphoreCreateInfo{};
 	semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-	ErrorCheck(vkCreateSemaphore(m_pDevice->GetDevice(), &semaphoreCreateInfo, nullptr, &m_PresentCompleteSemaphore));
 
-	ErrorCheck(vkCreateSemaphore(m_pDevice->GetDevice(), &semaphoreCreateInfo, nullptr, &m_RenderCompleteSemaphore));
-
-	VkFenceCreateInfo fenceCreateInfo{};
-	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-	m_WaitFences.resize(m_pSwapchain->GetImageCount());
-	for (size_t i = 0; i < m_WaitFences.size(); i++)
+	m_PresentCompleteSemaphores.resize(m_FramesInFlight);
+	m_RenderCompleteSemaphores.resize(m_FramesInFlight);
+	for (size_t i = 0; i < m_FramesInFlight; i++)
 	{
-		ErrorCheck(vkCreateFence(m_pDevice->GetDevice(), &fenceCreateInfo, nullptr, &m_WaitFences[i]));
+		ErrorCheck(vkCreateSemaphore(m_pDevice->GetDevice(), &semaphoreCreateInfo, nullptr, &m_PresentCompleteSemaphores[i]));
+		ErrorCheck(vkCreateSemaphore(m_pDevice->GetDevice(), &semaphoreCreateInfo, nullptr, &m_RenderCompleteSemaphores[i]));
 	}
+
+	m_pGraphicsTimeline = new QueueTimeline(m_pDevice, m_pDevice->GetQueue());
 }
 
 void VulkanBaseApp::InitSwapchain(VkPresentModeKHR preferredPresentMode, uint32_t swapchainImageCount)
@@ -105,7 +116,8 @@ void vkw::VulkanBaseApp::InitCommandPool(VkCommandPoolCreateFlags flags)
 
 void vkw::VulkanBaseApp::AllocateDrawCommandBuffers()
 {
-	m_DrawCommandBuffers.resize(m_pSwapchain->GetImageCount());
+	// Recorded every frame for the swapchain image it acquired
+	m_DrawCommandBuffers.resize(m_FramesInFlight);
 
 	VkCommandBufferAllocateInfo commandBufferAllocateInfo{};
 	commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -136,11 +148,11 @@ void VulkanBaseApp::CleanupWindow()
 
 void vkw::VulkanBaseApp::CleanupSynchronizations()
 {
-	vkDestroySemaphore(m_pDevice->GetDevice(), m_PresentCompleteSemaphore, nullptr);
-	vkDestroySemaphore(m_pDevice->GetDevice(), m_RenderCompleteSemaphore, nullptr);
-	for (size_t i = 0; i < m_WaitFences.size(); i++)
+	delete m_pGraphicsTimeline;
+	for (size_t i = 0; i < m_PresentCompleteSemaphores.size(); i++)
 	{
-		vkDestroyFence(m_pDevice->GetDevice(), m_WaitFences[i], nullptr);
+		vkDestroySemaphore(m_pDevice->GetDevice(), m_PresentCompleteSemaphores[i], nullptr);
+		vkDestroySemaphore(m_pDevice->GetDevice(), m_RenderCompleteSemaphores[i], nullptr);
 	}
 }
 
@@ -207,19 +219,19 @@ CommandPool * vkw::VulkanBaseApp::GetCommandPool()
 	return m_pCommandPool;
 }
 
-const VkSemaphore& vkw::VulkanBaseApp::GetPresentCompleteSemaphore()
+const VkSemaphore& vkw::VulkanBaseApp::GetPresentCompleteSemaphore(uint32_t frame)
 {
-	return m_PresentCompleteSemaphore;
+	return m_PresentCompleteSemaphores[frame];
 }
 
-const VkSemaphore& vkw::VulkanBaseApp::GetRenderCompleteSemaphore()
+const VkSemaphore& vkw::VulkanBaseApp::GetRenderCompleteSemaphore(uint32_t frame)
 {
-	return m_RenderCompleteSemaphore;
+	return m_RenderCompleteSemaphores[frame];
 }
 
-const std::vector<VkFence>& vkw::VulkanBaseApp::GetWaitFences()
+QueueTimeline* vkw::VulkanBaseApp::GetGraphicsTimeline()
 {
-	return m_WaitFences;
+	return m_pGraphicsTimeline;
 }
 
 const std::vector<VkCommandBuffer>& vkw::VulkanBaseApp::GetDrawCommandBuffers()
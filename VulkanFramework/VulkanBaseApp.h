@@ -12,6 +12,7 @@ namespace vkw
 	class RenderPass;
 	class FrameBuffer;
 	class CommandPool;
+	class QueueTimeline;
 	class VulkanBaseApp
 	{
 	public:
@@ -28,6 +29,10 @@ namespace vkw
 
 
 	protected:
+		// Frames the cpu records ahead of the gpu, every frame has its own semaphores and draw command buffer. Has to be set before Init.
+		void SetFramesInFlight(uint32_t frameCount);
+		uint32_t GetFramesInFlight();
+
 		void InitWindow(float width, float height);
 		void InitSynchronizations();
 		void InitSwapchain(VkPresentModeKHR preferredPresentMode = VK_PRESENT_MODE_MAILBOX_KHR, uint32_t swapchainImageCount = 2);
@@ -53,9 +58,10 @@ namespace vkw
 		Window* GetWindow();
 		RenderPass* GetRenderPass();
 		CommandPool* GetCommandPool();
-		const VkSemaphore& GetPresentCompleteSemaphore();
-		const VkSemaphore& GetRenderCompleteSemaphore();
-		const std::vector<VkFence>& GetWaitFences();
+		const VkSemaphore& GetPresentCompleteSemaphore(uint32_t frame);
+		const VkSemaphore& GetRenderCompleteSemaphore(uint32_t frame);
+		// Signaled by every submit to the graphics queue, a frame slot can be reused once the value its draw command buffer signaled completed
+		QueueTimeline* GetGraphicsTimeline();
 		const std::vector<VkCommandBuffer>& GetDrawCommandBuffers();
 		const std::vector<FrameBuffer*>& GetFrameBuffers();
 
@@ -69,9 +75,10 @@ namespace vkw
 		RenderPass*						m_pRenderPass = nullptr;
 		std::vector<FrameBuffer*>		m_FrameBuffers{};
 		CommandPool*					m_pCommandPool = nullptr;
-		VkSemaphore						m_PresentCompleteSemaphore = VK_NULL_HANDLE;
-		VkSemaphore						m_RenderCompleteSemaphore = VK_NULL_HANDLE;
-		std::vector<VkFence>			m_WaitFences{};
+		uint32_t						m_FramesInFlight{ 2 };
+		std::vector<VkSemaphore>		m_PresentCompleteSemaphores{};
+		std::vector<VkSemaphore>		m_RenderCompleteSemaphores{};
+		QueueTimeline*					m_pGraphicsTimeline = nullptr;
 		std::vector<VkCommandBuffer>	m_DrawCommandBuffers{};
 	};
 }
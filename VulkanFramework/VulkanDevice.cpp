@@ -6,6 +6,7 @@
 #include <assert.h>
 #include "VulkanHelpers.h"
 #include "VulkanDevice.h"
+#include "MemoryAllocator.h"
 
 
 using namespace vkw;
@@ -68,6 +69,11 @@ const VkPhysicalDeviceMemoryProperties & VulkanDevice::GetPhysicalDeviceMemoryPr
 	return m_GPUMemoryProperties;
 }
 
+MemoryAllocator* VulkanDevice::GetAllocator() const
+{
+	return m_pAllocator;
+}
+
 const VkPhysicalDeviceFeatures & vkw::VulkanDevice::GetDeviceFeatures() const
 {
 	return m_Features;
@@ -88,7 +94,7 @@ void VulkanDevice::InitInstance()
 {
 	VkApplicationInfo ApplicationInfo{};
 	ApplicationInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-	ApplicationInfo.apiVersion = VK_API_VERSION_1_1;
+	ApplicationInfo.apiVersion = VK_API_VERSION_1_2;
 	ApplicationInfo.applicationVersion = VK_MAKE_VERSION(0, 1, 0);
 	ApplicationInfo.pApplicationName = "Vulkan Framework";
 
@@ -198,8 +204,28 @@ void VulkanDevice::InitDevice()
 	graphicsQueueCreateInfo.pQueuePriorities = queuePriorities;
 	deviceQueueCreateInfos.push_back(graphicsQueueCreateInfo);
 
+	// Queues synchronize with each other and with the host through timeline semaphores
+	VkPhysicalDeviceVulkan12Features supportedFeatures12{};
+	supportedFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	VkPhysicalDeviceFeatures2 supportedFeatures{};
+	supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	supportedFeatures.pNext = &supportedFeatures12;
+	if (m_GPUProperties.apiVersion >= VK_API_VERSION_1_2)
+		vkGetPhysicalDeviceFeatures2(m_pGPU, &supportedFeatures);
+
+	if (!supportedFeatures12.timelineSemaphore)
+	{
+		assert(0 && "Vulkan ERROR: Timeline semaphores not supported!");
+		std::exit(-1);
+	}
+
+	VkPhysicalDeviceVulkan12Features enabledFeatures12{};
+	enabledFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	enabledFeatures12.timelineSemaphore = VK_TRUE;
+
 	VkDeviceCreateInfo deviceCreateInfo {};
 	deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	deviceCreateInfo.pNext = &enabledFeatures12;
 	deviceCreateInfo.queueCreateInfoCount = deviceQueueCreateInfos.size();
 	deviceCreateInfo.pQueueCreateInfos = deviceQueueCreateInfos.data();
 	deviceCreateInfo.enabledLayerCount = m_DeviceLayers.size();
@@ -210,10 +236,14 @@ void VulkanDevice::InitDevice()
 	ErrorCheck(vkCreateDevice(m_pGPU, &deviceCreateInfo, nullptr, &m_pDevice));
 
 	vkGetDeviceQueue(m_pDevice, m_GraphicsQueueFamilyId, 0, &m_pQueue);
+
+	m_pAllocator = new MemoryAllocator(this);
 }
 
 void VulkanDevice::DeInitDevice()
 {
+	delete m_pAllocator;
+	m_pAllocator = nullptr;
 	vkDestroyDevice(m_pDevice, nullptr);
 	m_pDevice = VK_NULL_HANDLE;
 }
@@ -5,6 +5,7 @@
 namespace vkw
 {
 	class Window;
+	class MemoryAllocator;
 
 	class VulkanDevice
 	{
@@ -21,6 +22,7 @@ namespace vkw
 		const  VkPhysicalDeviceProperties& GetPhysicalDeviceProperties() const;
 		const VkPhysicalDeviceMemoryProperties & GetPhysicalDeviceMemoryProperties() const;
 		const VkPhysicalDeviceFeatures& GetDeviceFeatures() const;
+		MemoryAllocator* GetAllocator() const;
 
 	private:
 		void SetUpLayersAndExtensions();
@@ -44,6 +46,8 @@ namespace vkw
 		VkPhysicalDeviceMemoryProperties m_GPUMemoryProperties{};
 		VkDevice m_pDevice = VK_NULL_HANDLE;
 		VkQueue m_pQueue = VK_NULL_HANDLE;
+		// Every buffer and image gets its memory from here
+		MemoryAllocator* m_pAllocator = nullptr;
 
 
 		uint32_t m_GraphicsQueueFamilyId = 0;
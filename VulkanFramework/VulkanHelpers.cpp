@@ -3,6 +3,7 @@
 #include <assert.h>
 #include "BUILD_OPTIONS.h"
 #include "VulkanHelpers.h"
+#include "MemoryAllocator.h"
 #include <array>
 
 #if BUILD_ENABLE_VULKAN_RUNTIME_DEBUG
@@ -158,7 +159,7 @@ std::array<VkVertexInputAttributeDescription, 3> Vertex::getAttributeDescription
 	return attributeDescriptions;
 }
 
-void CreateBuffer(VkDevice device, VkPhysicalDeviceMemoryProperties deviceMemoryProperties, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory)
+void CreateBuffer(VkDevice device, vkw::MemoryAllocator* pAllocator, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, vkw::Allocation& bufferAllocation)
 {
 	VkBufferCreateInfo bufferInfo{};
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -167,17 +168,7 @@ void CreateBuffer(VkDevice device, VkPhysicalDeviceMemoryProperties deviceMemory
 	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
 	ErrorCheck(vkCreateBuffer(device, &bufferInfo, nullptr, &buffer));
-
-	VkMemoryRequirements memRequirements;
-	vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
-
-	VkMemoryAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = FindMemoryTypeIndex(&deviceMemoryProperties, &memRequirements, properties);
-
-	ErrorCheck(vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory));
-	vkBindBufferMemory(device, buffer, bufferMemory, 0);
+	bufferAllocation = pAllocator->AllocateBufferMemory(buffer, properties);
 }
 
 void CopyBuffer(VkDevice device,  VkQueue graphicsQueue, VkCommandPool cmdPool, VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
@@ -192,7 +183,7 @@ void CopyBuffer(VkDevice device,  VkQueue graphicsQueue, VkCommandPool cmdPool,
 	EndSingleTimeCommands(device, graphicsQueue, cmdPool, commandBuffer);
 }
 
-void CreateImage(VkDevice device, const VkPhysicalDeviceMemoryProperties& physicalDeviceMemProperties ,uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory, uint32_t arrayLayers, uint32_t mipLevels, VkImageCreateFlags flags)
+void CreateImage(VkDevice device, vkw::MemoryAllocator* pAllocator, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, vkw::Allocation& imageAllocation, uint32_t arrayLayers, uint32_t mipLevels, VkImageCreateFlags flags)
 {
 	VkImageCreateInfo imageInfo{};
 	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -210,18 +201,7 @@ void CreateImage(VkDevice device, const VkPhysicalDeviceMemoryProperties& physic
 	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
 	imageInfo.flags = flags;
 	ErrorCheck(vkCreateImage(device, &imageInfo, nullptr, &image));
-
-	VkMemoryRequirements memRequirements;
-	vkGetImageMemoryRequirements(device, image, &memRequirements);
-
-	VkMemoryAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = FindMemoryTypeIndex(&physicalDeviceMemProperties, &memRequirements, properties);
-
-	ErrorCheck(vkAllocateMemory(device, &allocInfo, nullptr, &imageMemory));
-
-	vkBindImageMemory(device, image, imageMemory, 0);
+	imageAllocation = pAllocator->AllocateImageMemory(image, properties, tiling == VK_IMAGE_TILING_LINEAR);
 };
 
 VkCommandBuffer BeginSingleTimeCommands(VkDevice device, VkCommandPool commandPool) {
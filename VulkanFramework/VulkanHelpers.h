@@ -2,10 +2,15 @@
 #include "glm/glm.hpp"
 #include <array>
 enum VkResult;
+namespace vkw
+{
+	class MemoryAllocator;
+	struct Allocation;
+}
 void ErrorCheck(VkResult result);
-void CreateBuffer(VkDevice device, VkPhysicalDeviceMemoryProperties deviceMemoryProperties, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer & buffer, VkDeviceMemory & bufferMemory);
+void CreateBuffer(VkDevice device, vkw::MemoryAllocator* pAllocator, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer & buffer, vkw::Allocation & bufferAllocation);
 void CopyBuffer(VkDevice device, VkQueue graphicsQueue, VkCommandPool cmdPool, VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
-void CreateImage(VkDevice device, const VkPhysicalDeviceMemoryProperties & physicalDeviceMemProperties, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage & image, VkDeviceMemory & imageMemory, uint32_t arrayLayers = 1, uint32_t mipLevels = 1, VkImageCreateFlags flags = 0);
+void CreateImage(VkDevice device, vkw::MemoryAllocator* pAllocator, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage & image, vkw::Allocation & imageAllocation, uint32_t arrayLayers = 1, uint32_t mipLevels = 1, VkImageCreateFlags flags = 0);
 VkCommandBuffer BeginSingleTimeCommands(VkDevice device, VkCommandPool commandPool);
 void EndSingleTimeCommands(VkDevice device, VkQueue graphicsQueue, VkCommandPool commandPool, VkCommandBuffer commandBuffer);
 void TransitionImageLayout(VkDevice device, VkQueue graphicsQueue, VkCommandPool cmdPool, VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t arrayLayers = 1, uint32_t mipLevels = 1);
@@ -0,0 +1,276 @@
+#include "WavefrontTracer.h"
+#include "VulkanHelpers.h"
+#include "VulkanDevice.h"
+#include "Buffer.h"
+#include "Shader.h"
+#include "Helper.h"
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+WavefrontTracer::WavefrontTracer(vkw::VulkanDevice* pDevice, vkw::CommandPool* pCommandPool, VkDescriptorSetLayout sceneSetLayout, const VkSpecializationInfo* pSpecializationInfo, uint32_t width, uint32_t height, uint32_t frameCount)
+	:m_pDevice(pDevice)
+	,m_Width(width)
+	,m_Height(height)
+	,m_TraceWidth(width)
+	,m_TraceHeight(height)
+{
+	CreateBuffers(pCommandPool, frameCount);
+	CreateDescriptorSet();
+	CreatePipelines(sceneSetLayout, pSpecializationInfo);
+}
+
+WavefrontTracer::~WavefrontTracer()
+{
+	for (VkPipeline pipeline : m_Pipelines)
+	{
+		vkDestroyPipeline(m_pDevice->GetDevice(), pipeline, nullptr);
+	}
+	vkDestroyPipelineLayout(m_pDevice->GetDevice(), m_PipelineLayout, nullptr);
+	vkDestroyDescriptorPool(m_pDevice->GetDevice(), m_DescriptorPool, nullptr);
+	vkDestroyDescriptorSetLayout(m_pDevice->GetDevice(), m_DescriptorSetLayout, nullptr);
+
+	delete m_pCounterBuffer;
+	delete m_pRayCountBuffer;
+	delete m_pRayBuffer;
+	delete m_pHitBuffer;
+	delete m_pShadowRayBuffer;
+	delete m_pRadianceBuffer;
+}
+
+void WavefrontTracer::RecordTrace(VkCommandBuffer commandBuffer, VkDescriptorSet sceneSet, uint32_t uniformOffset, uint32_t maxDepth, uint32_t frame)
+{
+	// The previous trace has to be done with the counters before they are reset
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+	vkCmdFillBuffer(commandBuffer, m_pCounterBuffer->GetDescriptor().buffer, 0, VK_WHOLE_SIZE, 0);
+
+	VkMemoryBarrier fillBarrier{};
+	fillBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	fillBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	fillBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &fillBarrier, 0, nullptr, 0, nullptr);
+
+	std::array<VkDescriptorSet, 2> descriptorSets{ sceneSet, m_DescriptorSet };
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_PipelineLayout, 0, descriptorSets.size(), descriptorSets.data(), 1, &uniformOffset);
+
+	RecordPass(commandBuffer, GeneratePass, 0, 0);
+	RecordBarrier(commandBuffer);
+	for (uint32_t bounce = 0; bounce < maxDepth; bounce++)
+	{
+		RecordPass(commandBuffer, ArgsPass, bounce, 0);
+		RecordBarrier(commandBuffer);
+		RecordPass(commandBuffer, ExtendPass, bounce, 0);
+		RecordBarrier(commandBuffer);
+		RecordPass(commandBuffer, ShadePass, bounce, 0);
+		RecordBarrier(commandBuffer);
+		RecordPass(commandBuffer, ArgsPass, bounce, 1);
+		RecordBarrier(commandBuffer);
+		RecordPass(commandBuffer, ConnectPass, bounce, 0);
+		RecordBarrier(commandBuffer);
+	}
+	RecordPass(commandBuffer, ResolvePass, 0, 0);
+
+	// Copies the ray count to the slot of the frame and makes it visible to GetTracedRayCount once the submit completed
+	VkMemoryBarrier copyBarrier{};
+	copyBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	copyBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	copyBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &copyBarrier, 0, nullptr, 0, nullptr);
+
+	VkBufferCopy copyRegion{};
+	copyRegion.srcOffset = offsetof(Counters, totalRayCount);
+	copyRegion.dstOffset = frame * sizeof(uint32_t);
+	copyRegion.size = sizeof(uint32_t);
+	vkCmdCopyBuffer(commandBuffer, m_pCounterBuffer->GetDescriptor().buffer, m_pRayCountBuffer->GetDescriptor().buffer, 1, &copyRegion);
+
+	VkMemoryBarrier hostBarrier{};
+	hostBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &hostBarrier, 0, nullptr, 0, nullptr);
+}
+
+uint32_t WavefrontTracer::GetTracedRayCount(uint32_t frame)
+{
+	std::vector<uint32_t> rayCounts(frame + 1);
+	m_pRayCountBuffer->Read(rayCounts.data(), rayCounts.size() * sizeof(uint32_t));
+	return rayCounts[frame];
+}
+
+void WavefrontTracer::SetTraceSize(uint32_t width, uint32_t height)
+{
+	m_TraceWidth = width;
+	m_TraceHeight = height;
+}
+
+void WavefrontTracer::CreateBuffers(vkw::CommandPool* pCommandPool, uint32_t frameCount)
+{
+	// Size of a ray and hit in wavefront.comp
+	const size_t rayStride = 3 * sizeof(glm::vec4);
+	const size_t hitStride = 2 * sizeof(glm::vec4);
+	const size_t pixelCount = size_t(m_Width) * m_Height;
+
+	m_pCounterBuffer = new vkw::Buffer(
+		m_pDevice, pCommandPool,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		sizeof(Counters), nullptr
+	);
+	// Host visible so the ray counts can be read back for the statistics
+	m_pRayCountBuffer = new vkw::Buffer(
+		m_pDevice, pCommandPool,
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		frameCount * sizeof(uint32_t), nullptr
+	);
+	// Every queue has room for a ray per pixel, there is never more than one path per pixel
+	m_pRayBuffer = new vkw::Buffer(m_pDevice, pCommandPool, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 2 * pixelCount * rayStride, nullptr);
+	m_pHitBuffer = new vkw::Buffer(m_pDevice, pCommandPool, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, pixelCount * hitStride, nullptr);
+	m_pShadowRayBuffer = new vkw::Buffer(m_pDevice, pCommandPool, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, pixelCount * rayStride, nullptr);
+	m_pRadianceBuffer = new vkw::Buffer(m_pDevice, pCommandPool, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, pixelCount * sizeof(glm::vec4), nullptr);
+}
+
+void WavefrontTracer::CreateDescriptorSet()
+{
+	const uint32_t bindingCount{ 5 };
+	std::array<VkDescriptorSetLayoutBinding, bindingCount> setLayoutBindings{};
+	for (uint32_t i = 0; i < bindingCount; i++)
+	{
+		setLayoutBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		setLayoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		setLayoutBindings[i].binding = i;
+		setLayoutBindings[i].descriptorCount = 1;
+	}
+
+	VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo{};
+	descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	descriptorSetLayoutCreateInfo.pBindings = setLayoutBindings.data();
+	descriptorSetLayoutCreateInfo.bindingCount = setLayoutBindings.size();
+
+	ErrorCheck(vkCreateDescriptorSetLayout(m_pDevice->GetDevice(), &descriptorSetLayoutCreateInfo, nullptr, &m_DescriptorSetLayout));
+
+	VkDescriptorPoolSize poolSize{};
+	poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSize.descriptorCount = bindingCount;
+
+	VkDescriptorPoolCreateInfo descriptorPoolInfo{};
+	descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptorPoolInfo.poolSizeCount = 1;
+	descriptorPoolInfo.pPoolSizes = &poolSize;
+	descriptorPoolInfo.maxSets = 1;
+
+	ErrorCheck(vkCreateDescriptorPool(m_pDevice->GetDevice(), &descriptorPoolInfo, nullptr, &m_DescriptorPool));
+
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = m_DescriptorPool;
+	allocInfo.pSetLayouts = &m_DescriptorSetLayout;
+	allocInfo.descriptorSetCount = 1;
+
+	ErrorCheck(vkAllocateDescriptorSets(m_pDevice->GetDevice(), &allocInfo, &m_DescriptorSet));
+
+	// Binding order matches set 1 of wavefront.comp
+	std::array<VkDescriptorBufferInfo, bindingCount> bufferInfos{
+		m_pCounterBuffer->GetDescriptor(),
+		m_pRayBuffer->GetDescriptor(),
+		m_pHitBuffer->GetDescriptor(),
+		m_pShadowRayBuffer->GetDescriptor(),
+		m_pRadianceBuffer->GetDescriptor()
+	};
+
+	std::array<VkWriteDescriptorSet, bindingCount> writeDescriptorSets{};
+	for (uint32_t i = 0; i < bindingCount; i++)
+	{
+		writeDescriptorSets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeDescriptorSets[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writeDescriptorSets[i].descriptorCount = 1;
+		writeDescriptorSets[i].dstBinding = i;
+		writeDescriptorSets[i].dstSet = m_DescriptorSet;
+		writeDescriptorSets[i].pBufferInfo = &bufferInfos[i];
+	}
+	vkUpdateDescriptorSets(m_pDevice->GetDevice(), writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
+}
+
+void WavefrontTracer::CreatePipelines(VkDescriptorSetLayout sceneSetLayout, const VkSpecializationInfo* pSpecializationInfo)
+{
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(PushConstants);
+
+	std::array<VkDescriptorSetLayout, 2> setLayouts{ sceneSetLayout, m_DescriptorSetLayout };
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{};
+	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutCreateInfo.pSetLayouts = setLayouts.data();
+	pipelineLayoutCreateInfo.setLayoutCount = setLayouts.size();
+	pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+	pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+
+	ErrorCheck(vkCreatePipelineLayout(m_pDevice->GetDevice(), &pipelineLayoutCreateInfo, nullptr, &m_PipelineLayout));
+
+	// Every pass is compiled from wavefront.comp with its own define, see generate-spirv.bat
+	const std::array<std::string, PassCount> shaderFiles{
+		"Shaders/wavefront_generate.comp.spv",
+		"Shaders/wavefront_args.comp.spv",
+		"Shaders/wavefront_extend.comp.spv",
+		"Shaders/wavefront_shade.comp.spv",
+		"Shaders/wavefront_connect.comp.spv",
+		"Shaders/wavefront_resolve.comp.spv"
+	};
+
+	for (uint32_t pass = 0; pass < PassCount; pass++)
+	{
+		VkShaderModule shaderModule = CreateShaderModule(readFile(shaderFiles[pass]), m_pDevice->GetDevice());
+
+		VkPipelineShaderStageCreateInfo shaderStageInfo{};
+		shaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		shaderStageInfo.module = shaderModule;
+		shaderStageInfo.pName = "main";
+		shaderStageInfo.pSpecializationInfo = pSpecializationInfo;
+
+		VkComputePipelineCreateInfo computePipelineCreateInfo{};
+		computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		computePipelineCreateInfo.layout = m_PipelineLayout;
+		computePipelineCreateInfo.flags = 0;
+		computePipelineCreateInfo.stage = shaderStageInfo;
+
+		ErrorCheck(vkCreateComputePipelines(m_pDevice->GetDevice(), VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &m_Pipelines[pass]));
+
+		vkDestroyShaderModule(m_pDevice->GetDevice(), shaderModule, nullptr);
+	}
+}
+
+void WavefrontTracer::RecordPass(VkCommandBuffer commandBuffer, Pass pass, uint32_t bounce, uint32_t argsStage)
+{
+	PushConstants pushConstants{ m_Width, m_Height, bounce, argsStage };
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_Pipelines[pass]);
+	vkCmdPushConstants(commandBuffer, m_PipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+
+	VkBuffer counterBuffer = m_pCounterBuffer->GetDescriptor().buffer;
+	switch (pass)
+	{
+	case ArgsPass:
+		vkCmdDispatch(commandBuffer, 1, 1, 1);
+		break;
+	case ExtendPass:
+	case ShadePass:
+		vkCmdDispatchIndirect(commandBuffer, counterBuffer, offsetof(Counters, extendArgs));
+		break;
+	case ConnectPass:
+		vkCmdDispatchIndirect(commandBuffer, counterBuffer, offsetof(Counters, connectArgs));
+		break;
+	default:
+		vkCmdDispatch(commandBuffer, (m_TraceWidth * m_TraceHeight + WorkGroupSize - 1) / WorkGroupSize, 1, 1);
+		break;
+	}
+}
+
+void WavefrontTracer::RecordBarrier(VkCommandBuffer commandBuffer)
+{
+	// The queues are read by the next pass and the counters also as indirect arguments
+	VkMemoryBarrier memoryBarrier{};
+	memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include "Platform.h"
+#include <array>
+
+namespace vkw
+{
+	class VulkanDevice;
+	class CommandPool;
+	class Buffer;
+}
+
+// Wavefront alternative to the raytracing.comp megakernel: every bounce is split in an extend (closest hit), shade and connect (shadow ray) pass.
+// The passes hand their rays to each other through queues in storage buffers with atomic counters,
+// a single invocation args pass turns those counters into the sizes of the indirect dispatches that follow it.
+// The scene is read through the descriptor set of the megakernel, which is bound as set 0, every pass is specialized with its constants.
+class WavefrontTracer
+{
+public:
+	WavefrontTracer(vkw::VulkanDevice* pDevice, vkw::CommandPool* pCommandPool, VkDescriptorSetLayout sceneSetLayout, const VkSpecializationInfo* pSpecializationInfo, uint32_t width, uint32_t height, uint32_t frameCount);
+	~WavefrontTracer();
+
+	// Records a complete frame, the result is added to the running mean in the scene set's accumulation image.
+	// Passes are recorded for maxDepth bounces, paths that end earlier leave the later indirect dispatches empty.
+	// The ray count is copied to a readback slot per frame in flight, so later traces do not overwrite it before it is read.
+	void RecordTrace(VkCommandBuffer commandBuffer, VkDescriptorSet sceneSet, uint32_t uniformOffset, uint32_t maxDepth, uint32_t frame);
+	// Extension and shadow rays traced by the last trace of the frame, only valid once its command buffer completed
+	uint32_t GetTracedRayCount(uint32_t frame);
+	// Rays are generated and resolved for the traced rectangle only, the command buffers have to be recorded again after it changed
+	void SetTraceSize(uint32_t width, uint32_t height);
+
+	static const uint32_t	WorkGroupSize{ 256 };
+
+private:
+	enum Pass
+	{
+		GeneratePass,
+		ArgsPass,
+		ExtendPass,
+		ShadePass,
+		ConnectPass,
+		ResolvePass,
+		PassCount
+	};
+
+	// Matches Counters in wavefront.comp
+	struct Counters
+	{
+		uint32_t rayCount[2];
+		uint32_t shadowRayCount;
+		uint32_t totalRayCount;
+		VkDispatchIndirectCommand extendArgs;
+		uint32_t pad1;
+		VkDispatchIndirectCommand connectArgs;
+		uint32_t pad2;
+	};
+
+	struct PushConstants
+	{
+		uint32_t width;
+		uint32_t height;
+		uint32_t bounce;
+		uint32_t argsStage;
+	};
+
+	void CreateBuffers(vkw::CommandPool* pCommandPool, uint32_t frameCount);
+	void CreateDescriptorSet();
+	void CreatePipelines(VkDescriptorSetLayout sceneSetLayout, const VkSpecializationInfo* pSpecializationInfo);
+	void RecordPass(VkCommandBuffer commandBuffer, Pass pass, uint32_t bounce, uint32_t argsStage);
+	void RecordBarrier(VkCommandBuffer commandBuffer);
+
+	vkw::VulkanDevice*					m_pDevice = nullptr;
+	uint32_t							m_Width{};
+	uint32_t							m_Height{};
+	uint32_t							m_TraceWidth{};
+	uint32_t							m_TraceHeight{};
+
+	vkw::Buffer*						m_pCounterBuffer = nullptr;
+	// Host visible total ray count per frame in flight
+	vkw::Buffer*						m_pRayCountBuffer = nullptr;
+	vkw::Buffer*						m_pRayBuffer = nullptr;
+	vkw::Buffer*						m_pHitBuffer = nullptr;
+	vkw::Buffer*						m_pShadowRayBuffer = nullptr;
+	vkw::Buffer*						m_pRadianceBuffer = nullptr;
+
+	VkDescriptorPool					m_DescriptorPool = VK_NULL_HANDLE;
+	VkDescriptorSetLayout				m_DescriptorSetLayout = VK_NULL_HANDLE;
+	VkDescriptorSet						m_DescriptorSet = VK_NULL_HANDLE;
+	VkPipelineLayout					m_PipelineLayout = VK_NULL_HANDLE;
+	std::array<VkPipeline, PassCount>	m_Pipelines{};
+};
@@ -0,0 +1,148 @@
+#include "WideBVH.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+static_assert(sizeof(WideBVHNode) == 64, "WideBVHNode has to match the shader layout!");
+
+void WideBVH::Build(const std::vector<BVHNode>& binaryNodes)
+{
+	m_Nodes.clear();
+	m_MaxDepth = 0;
+	if (binaryNodes.empty())
+		return;
+
+	// The leaf encoding has no room for larger leaves or primitive indices, checked up front in every configuration
+	for (const BVHNode& node : binaryNodes)
+	{
+		if (!(node.rightCount & BVH_LEAF_BIT))
+			continue;
+		uint32_t count = node.rightCount & ~BVH_LEAF_BIT;
+		if (count == 0 || count > MaxLeafSize || node.leftFirst > WIDE_BVH_FIRST_MASK)
+		{
+			std::cout << "WideBVH: leaf with " << count << " primitives from " << node.leftFirst << " can't be encoded, at most "
+				<< MaxLeafSize << " primitives from " << WIDE_BVH_FIRST_MASK << " fit" << std::endl;
+			assert("Leaf can't be encoded in the wide bvh!" && 0);
+			std::exit(-1);
+		}
+	}
+
+	// Every wide node replaces at least one interior binary node
+	m_Nodes.reserve(std::max(binaryNodes.size() / 2, size_t(1)));
+	Collapse(binaryNodes, 0, 0);
+}
+
+const std::vector<WideBVHNode>& WideBVH::GetNodes() const
+{
+	return m_Nodes;
+}
+
+uint32_t WideBVH::GetMaxDepth() const
+{
+	return m_MaxDepth;
+}
+
+uint32_t WideBVH::Collapse(const std::vector<BVHNode>& binaryNodes, uint32_t binaryNode, uint32_t depth)
+{
+	m_MaxDepth = std::max(m_MaxDepth, depth);
+	uint32_t children[Width]{};
+	uint32_t childCount{ 0 };
+	const BVHNode& node = binaryNodes[binaryNode];
+	if (node.rightCount & BVH_LEAF_BIT)
+	{
+		// Only happens for the root, the wide root then has a single leaf child
+		children[childCount++] = binaryNode;
+	}
+	else
+	{
+		children[childCount++] = node.leftFirst;
+		children[childCount++] = node.rightCount;
+	}
+
+	while (childCount < Width)
+	{
+		int largest{ -1 };
+		float largestArea{ -1.f };
+		for (uint32_t i = 0; i < childCount; i++)
+		{
+			const BVHNode& child = binaryNodes[children[i]];
+			if (child.rightCount & BVH_LEAF_BIT)
+				continue;
+			float area = AABB{ child.min, child.max }.GetSurfaceArea();
+			if (area > largestArea)
+			{
+				largest = int(i);
+				largestArea = area;
+			}
+		}
+		if (largest == -1)
+			break;
+
+		const BVHNode& opened = binaryNodes[children[largest]];
+		children[largest] = opened.leftFirst;
+		children[childCount++] = opened.rightCount;
+	}
+
+	uint32_t wideIndex = uint32_t(m_Nodes.size());
+	m_Nodes.emplace_back();
+
+	WideBVHNode wideNode{};
+	AABB bounds{};
+	for (uint32_t i = 0; i < childCount; i++)
+	{
+		bounds.Grow(AABB{ binaryNodes[children[i]].min, binaryNodes[children[i]].max });
+	}
+	wideNode.origin = bounds.min;
+	wideNode.meta = childCount << 24;
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		// Smallest power of two step that still covers the extent in 255 steps
+		float extent = bounds.max[axis] - bounds.min[axis];
+		int exponent = (extent > 0.f) ? int(std::ceil(std::log2(extent / 255.f))) : -126;
+		while (std::ldexp(255.f, exponent) < extent)
+		{
+			exponent++;
+		}
+		exponent = std::min(std::max(exponent, -126), 127);
+		wideNode.meta |= uint32_t(exponent + 127) << (axis * 8);
+
+		float step = std::ldexp(1.f, exponent);
+		for (uint32_t i = 0; i < childCount; i++)
+		{
+			const BVHNode& child = binaryNodes[children[i]];
+			int quantizedMin = std::min(std::max(int(std::floor((child.min[axis] - wideNode.origin[axis]) / step)), 0), 255);
+			int quantizedMax = std::min(std::max(int(std::ceil((child.max[axis] - wideNode.origin[axis]) / step)), 0), 255);
+			// Rounding of the decoded values may not shrink the box
+			while (quantizedMin > 0 && wideNode.origin[axis] + quantizedMin * step > child.min[axis])
+			{
+				quantizedMin--;
+			}
+			while (quantizedMax < 255 && wideNode.origin[axis] + quantizedMax * step < child.max[axis])
+			{
+				quantizedMax++;
+			}
+			wideNode.quantizedMin[axis] |= uint32_t(quantizedMin) << (i * 8);
+			wideNode.quantizedMax[axis] |= uint32_t(quantizedMax) << (i * 8);
+		}
+	}
+
+	for (uint32_t i = 0; i < childCount; i++)
+	{
+		const BVHNode& child = binaryNodes[children[i]];
+		wideNode.children[i] = (child.rightCount & BVH_LEAF_BIT) ? EncodeLeaf(child) : Collapse(binaryNodes, children[i], depth + 1);
+	}
+
+	// Children are collapsed first, so the vector may have grown in the meantime
+	m_Nodes[wideIndex] = wideNode;
+	return wideIndex;
+}
+
+uint32_t WideBVH::EncodeLeaf(const BVHNode& leaf)
+{
+	// Checked by Build
+	uint32_t count = leaf.rightCount & ~BVH_LEAF_BIT;
+	return BVH_LEAF_BIT | ((count - 1) << WIDE_BVH_COUNT_SHIFT) | leaf.leftFirst;
+}
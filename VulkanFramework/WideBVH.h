@@ -0,0 +1,41 @@
+#pragma once
+#include "BVH.h"
+
+// Node layout as it is uploaded to the gpu, matches WideBVHNode in raytracing.comp (64 bytes, std430).
+// Child bounds are stored as 8 bit offsets from origin in steps of a power of two per axis, decoded bounds always enclose the real ones.
+// Interior children store the index of their node, leaf children have BVH_LEAF_BIT set with the primitive count - 1 in the bits above WIDE_BVH_FIRST_MASK.
+struct WideBVHNode
+{
+	glm::vec3 origin;
+	uint32_t meta;					// Biased exponent of the x, y and z step in the lower three bytes, child count in the top byte
+	uint32_t children[4];
+	uint32_t quantizedMin[3];		// One byte per child for every axis
+	uint32_t quantizedMax[3];
+	uint32_t pad[2];
+};
+
+static const uint32_t WIDE_BVH_FIRST_MASK = 0x0FFFFFFFu;
+static const uint32_t WIDE_BVH_COUNT_SHIFT = 28;
+
+// 4 wide bvh collapsed from a binary one, by repeatedly opening the child with the largest surface area.
+// Leaves and their primitive ranges are kept as they are, so the primitive order of the binary bvh stays valid.
+class WideBVH
+{
+public:
+	// Exits when a leaf holds more than MaxLeafSize primitives or starts past WIDE_BVH_FIRST_MASK
+	void Build(const std::vector<BVHNode>& binaryNodes);
+
+	const std::vector<WideBVHNode>& GetNodes() const;
+	// Levels below the root of the deepest wide node
+	uint32_t GetMaxDepth() const;
+
+	static const uint32_t	Width{ 4 };
+	static const uint32_t	MaxLeafSize{ 8 };
+
+private:
+	uint32_t Collapse(const std::vector<BVHNode>& binaryNodes, uint32_t binaryNode, uint32_t depth);
+	static uint32_t EncodeLeaf(const BVHNode& leaf);
+
+	std::vector<WideBVHNode>	m_Nodes{};
+	uint32_t					m_MaxDepth{};
+};